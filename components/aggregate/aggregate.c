@@ -0,0 +1,115 @@
+/*!
+ * @file aggregate.c
+ * @brief Nested tumbling windows with incremental mean and variance
+ */
+
+#include <math.h>
+#include <string.h>
+#include "aggregate.h"
+
+esp_err_t agg_init(agg_t *agg, const agg_config_t *config) {
+    if (config->channels == 0 || config->channels > AGG_MAX_CHANNELS ||
+        config->levels == 0 || config->levels > AGG_MAX_LEVELS || config->window_us[0] <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (unsigned l = 1; l < config->levels; l++) {
+        if (config->window_us[l] <= 0 || config->window_us[l] % config->window_us[l - 1]) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    memset(agg, 0, sizeof(*agg));
+    agg->config = *config;
+    return ESP_OK;
+}
+
+static int32_t round_to_int(double x) {
+    return (int32_t)lround(x);
+}
+
+// level 0 sums to mean and M2, once per window instead of per sample
+static void summarize(agg_t *agg) {
+    const double n = agg->count[0];
+    for (unsigned c = 0; c < agg->config.channels; c++) {
+        const agg_accum_t *a = &agg->accum[c];
+        agg_summary_t *s = &agg->summary[0][c];
+        s->min = a->min;
+        s->max = a->max;
+        s->mean = a->shift + a->sum / n;
+        s->m2 = (double)a->sum_sq - (double)a->sum * a->sum / n;
+        if (s->m2 < 0) s->m2 = 0;
+    }
+}
+
+// Chan et al.'s pairwise form of Welford's update, one window into a longer one
+static void merge(agg_summary_t *into, uint32_t into_count, const agg_summary_t *from, uint32_t from_count) {
+    if (into_count == 0) {
+        *into = *from;
+        return;
+    }
+    const double n = (double)into_count + from_count;
+    const double delta = from->mean - into->mean;
+    into->mean += delta * from_count / n;
+    into->m2 += from->m2 + delta * delta * into_count * from_count / n;
+    if (from->min < into->min) into->min = from->min;
+    if (from->max > into->max) into->max = from->max;
+}
+
+static void close_window(agg_t *agg, unsigned level) {
+    const uint32_t n = agg->count[level];
+    if (n == 0) return;
+    if (level == 0) summarize(agg);
+
+    if (agg->config.emit) {
+        agg_window_t window = {.level = level, .start_us = agg->start_us[level], .count = n};
+        for (unsigned c = 0; c < agg->config.channels; c++) {
+            const agg_summary_t *s = &agg->summary[level][c];
+            window.channel[c].min = s->min;
+            window.channel[c].max = s->max;
+            window.channel[c].mean = round_to_int(s->mean);
+            window.channel[c].stddev = n > 1 ? round_to_int(sqrt(s->m2 / (n - 1))) : 0;
+        }
+        agg->config.emit(agg->config.ctx, &window);
+    }
+
+    if (level + 1 < agg->config.levels) {
+        for (unsigned c = 0; c < agg->config.channels; c++) {
+            merge(&agg->summary[level + 1][c], agg->count[level + 1], &agg->summary[level][c], n);
+        }
+        agg->count[level + 1] += n;
+    }
+    agg->count[level] = 0;
+}
+
+void agg_add(agg_t *agg, int64_t timestamp_us, const int32_t *values) {
+    if (!agg->started) {
+        agg->started = true;
+        for (unsigned l = 0; l < agg->config.levels; l++) agg->start_us[l] = timestamp_us;
+    }
+
+    // shorter windows first, their summaries belong to the longer ones;
+    // a window that did not end leaves every longer one open too
+    for (unsigned l = 0; l < agg->config.levels; l++) {
+        const int64_t window = agg->config.window_us[l];
+        if (timestamp_us < agg->start_us[l] + window) break;
+        close_window(agg, l);
+        // skip the windows a gap left empty
+        agg->start_us[l] += (timestamp_us - agg->start_us[l]) / window * window;
+    }
+
+    const bool first = agg->count[0]++ == 0;
+    for (unsigned c = 0; c < agg->config.channels; c++) {
+        agg_accum_t *a = &agg->accum[c];
+        const int32_t v = values[c];
+        if (first) {
+            a->shift = a->min = a->max = v;
+            a->sum = 0;
+            a->sum_sq = 0;
+            continue;
+        }
+        const int64_t d = (int64_t)v - a->shift;
+        a->sum += d;
+        a->sum_sq += (uint64_t)(d * d);
+        if (v < a->min) a->min = v;
+        if (v > a->max) a->max = v;
+    }
+}
@@ -0,0 +1,89 @@
+/*!
+ * @file aggregate.h
+ * @brief Windowed min/max/mean/standard deviation over sample streams, in
+ *        fixed memory: samples go in at full rate, only one summary per
+ *        window comes out
+ *
+ * Windows are tumbling and nested, e.g. 1 s, 1 min, 1 h: each closed window
+ * is merged into the next longer one, so a level costs one summary per
+ * channel whatever its length.
+ */
+
+#ifndef __AGGREGATE_H__
+#define __AGGREGATE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define AGG_MAX_LEVELS 3
+#define AGG_MAX_CHANNELS 4
+
+// one channel of a closed window, in the units of its samples
+typedef struct {
+    int32_t min;
+    int32_t max;
+    int32_t mean;               // rounded
+    int32_t stddev;             // sample standard deviation, rounded; 0 below two samples
+} agg_stats_t;
+
+typedef struct {
+    unsigned level;             // index into agg_config_t.window_us
+    int64_t start_us;
+    uint32_t count;             // samples in the window
+    agg_stats_t channel[AGG_MAX_CHANNELS];
+} agg_window_t;
+
+// called from agg_add() for every window that closes with samples in it
+typedef void (*agg_emit_t)(void *ctx, const agg_window_t *window);
+
+typedef struct {
+    unsigned channels;
+    unsigned levels;
+    int64_t window_us[AGG_MAX_LEVELS];  // each a whole multiple of the one before
+    agg_emit_t emit;
+    void *ctx;
+} agg_config_t;
+
+// level 0 sums deviations from the window's first sample in integers, exact
+// for 2^24 samples within +-2^19 of it
+typedef struct {
+    int32_t shift;
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    uint64_t sum_sq;
+} agg_accum_t;
+
+// a closed window for merging: mean and sum of squared deviations (Welford's M2)
+typedef struct {
+    int32_t min;
+    int32_t max;
+    double mean;
+    double m2;
+} agg_summary_t;
+
+typedef struct {
+    agg_config_t config;
+    bool started;
+    int64_t start_us[AGG_MAX_LEVELS];
+    uint32_t count[AGG_MAX_LEVELS];
+    agg_accum_t accum[AGG_MAX_CHANNELS];
+    agg_summary_t summary[AGG_MAX_LEVELS][AGG_MAX_CHANNELS];   // [0] is the level 0 window being closed
+} agg_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t agg_init(agg_t *agg, const agg_config_t *config);
+
+// one sample per channel; timestamps must not go backwards. Windows are
+// aligned to the first sample and close when a sample lands past their end
+void agg_add(agg_t *agg, int64_t timestamp_us, const int32_t *values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __AGGREGATE_H__
@@ -0,0 +1,161 @@
+/*!
+ * @file i2c_bus.c
+ * @brief Shared I2C bus bring-up with per-device clock negotiation
+ */
+
+#include <inttypes.h>
+#include <string.h>
+#include "esp_log.h"
+#include "i2c_bus.h"
+
+static const char *TAG = "i2c_bus";
+
+// speeds a device steps down through, fastest first
+static const uint32_t s_speeds[] = {I2C_BUS_FAST_HZ, 200000, I2C_BUS_STD_HZ};
+
+esp_err_t i2c_bus_init(i2c_master_bus_handle_t *ret_bus) {
+    i2c_master_bus_config_t bus_config = {
+        .i2c_port = I2C_BUS_PORT,
+        .sda_io_num = I2C_BUS_SDA_IO,
+        .scl_io_num = I2C_BUS_SCL_IO,
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .glitch_ignore_cnt = 7,
+        .flags.enable_internal_pullup = true,
+    };
+
+    esp_err_t err = i2c_new_master_bus(&bus_config, ret_bus);
+    if (err == ESP_ERR_INVALID_STATE) {
+        // already brought up by another driver, share it
+        err = i2c_master_get_bus_handle(I2C_BUS_PORT, ret_bus);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "bus init failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+static esp_err_t add_device(i2c_master_bus_handle_t bus, uint16_t addr, uint32_t scl_hz,
+                            i2c_master_dev_handle_t *ret_dev) {
+    i2c_device_config_t dev_config = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = addr,
+        .scl_speed_hz = scl_hz,
+    };
+    return i2c_master_bus_add_device(bus, &dev_config, ret_dev);
+}
+
+esp_err_t i2c_bus_add(i2c_master_bus_handle_t bus, uint16_t addr, uint32_t max_hz, i2c_bus_dev_t *dev) {
+    memset(dev, 0, sizeof(*dev));
+    dev->bus = bus;
+    dev->addr = addr;
+    dev->scl_hz = max_hz;
+    dev->timeout_ms = I2C_BUS_TIMEOUT_MS;
+
+    // the probe runs at the driver's own rate, it only tells us someone is
+    // there; the speed is confirmed by the first real transfer
+    if (i2c_master_probe(bus, addr, I2C_BUS_TIMEOUT_MS) != ESP_OK) {
+        ESP_LOGW(TAG, "0x%02x did not answer the probe", addr);
+    }
+
+    esp_err_t err = add_device(bus, addr, max_hz, &dev->handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "add 0x%02x failed: %s", addr, esp_err_to_name(err));
+    }
+    return err;
+}
+
+void i2c_bus_attach(i2c_bus_dev_t *dev, i2c_master_dev_handle_t handle, uint32_t scl_hz) {
+    memset(dev, 0, sizeof(*dev));
+    dev->handle = handle;
+    dev->scl_hz = scl_hz;
+    dev->timeout_ms = I2C_BUS_TIMEOUT_MS;
+}
+
+// re-add the device at the next slower speed
+static esp_err_t step_down(i2c_bus_dev_t *dev) {
+    uint32_t next = 0;
+    for (size_t i = 0; i < sizeof(s_speeds) / sizeof(s_speeds[0]); i++) {
+        if (s_speeds[i] < dev->scl_hz) {
+            next = s_speeds[i];
+            break;
+        }
+    }
+    if (next == 0) return ESP_ERR_NOT_FOUND;
+
+    ESP_LOGW(TAG, "0x%02x failing at %" PRIu32 " Hz, stepping down to %" PRIu32 " Hz",
+             dev->addr, dev->scl_hz, next);
+    i2c_master_bus_rm_device(dev->handle);
+    dev->handle = NULL;
+    esp_err_t err = add_device(dev->bus, dev->addr, next, &dev->handle);
+    if (err != ESP_OK) return err;
+
+    dev->scl_hz = next;
+    dev->verified = 0;
+    dev->window = 0;
+    dev->window_errors = 0;
+    dev->step_downs++;
+    return ESP_OK;
+}
+
+// count the outcome of one transfer; true when the device was stepped down
+// and the transfer should be repeated at the new speed
+static bool account(i2c_bus_dev_t *dev, esp_err_t err) {
+    if (++dev->window >= I2C_BUS_WINDOW) {
+        dev->window = 0;
+        dev->window_errors = 0;
+    }
+    if (err == ESP_OK) {
+        dev->verified = 1;
+        return false;
+    }
+
+    if (err == ESP_ERR_TIMEOUT) {
+        dev->timeouts++;
+    } else {
+        dev->nacks++;
+    }
+    if (dev->bus == NULL) return false;
+
+    // an unconfirmed speed is dropped on the first failure, a proven one
+    // only when failures pile up
+    dev->window_errors++;
+    if (dev->verified && dev->window_errors < I2C_BUS_MAX_ERRORS) return false;
+    return step_down(dev) == ESP_OK;
+}
+
+static esp_err_t transfer(i2c_bus_dev_t *dev, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len) {
+    esp_err_t err;
+    do {
+        if (dev->handle == NULL) return ESP_ERR_INVALID_STATE;
+        if (rx == NULL) {
+            err = i2c_master_transmit(dev->handle, tx, tx_len, dev->timeout_ms);
+        } else if (tx == NULL) {
+            err = i2c_master_receive(dev->handle, rx, rx_len, dev->timeout_ms);
+        } else {
+            err = i2c_master_transmit_receive(dev->handle, tx, tx_len, rx, rx_len, dev->timeout_ms);
+        }
+    } while (account(dev, err));
+    return err;
+}
+
+esp_err_t i2c_bus_transmit(i2c_bus_dev_t *dev, const uint8_t *data, size_t len) {
+    return transfer(dev, data, len, NULL, 0);
+}
+
+esp_err_t i2c_bus_receive(i2c_bus_dev_t *dev, uint8_t *data, size_t len) {
+    return transfer(dev, NULL, 0, data, len);
+}
+
+esp_err_t i2c_bus_transmit_receive(i2c_bus_dev_t *dev, const uint8_t *tx, size_t tx_len,
+                                   uint8_t *rx, size_t rx_len) {
+    return transfer(dev, tx, tx_len, rx, rx_len);
+}
+
+esp_err_t i2c_bus_poll(i2c_bus_dev_t *dev, uint8_t *data, size_t len) {
+    if (dev->handle == NULL) return ESP_ERR_INVALID_STATE;
+    esp_err_t err = i2c_master_receive(dev->handle, data, len, dev->timeout_ms);
+    // a NACK only says the device is busy, the rest counts as usual; the
+    // caller polls again anyway, so a step down is not followed by a repeat
+    if (err == ESP_OK || err == ESP_ERR_TIMEOUT) account(dev, err);
+    return err;
+}
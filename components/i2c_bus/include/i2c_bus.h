@@ -0,0 +1,72 @@
+/*!
+ * @file i2c_bus.h
+ * @brief Shared I2C bus bring-up for the labs: one i2c_master bus on the
+ *        board's pins, devices that start at fast mode and step down on
+ *        their own when transfers start failing
+ */
+
+#ifndef __I2C_BUS_H__
+#define __I2C_BUS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+
+// the esp32c3 has a single I2C controller, wired to these pins on our boards
+#define I2C_BUS_PORT I2C_NUM_0
+#define I2C_BUS_SDA_IO GPIO_NUM_10
+#define I2C_BUS_SCL_IO GPIO_NUM_8
+#define I2C_BUS_TIMEOUT_MS 1000
+
+#define I2C_BUS_FAST_HZ 400000
+#define I2C_BUS_STD_HZ 100000
+
+// once a speed has worked, it is only dropped when I2C_BUS_MAX_ERRORS
+// transfers fail within I2C_BUS_WINDOW transfers
+#define I2C_BUS_WINDOW 64
+#define I2C_BUS_MAX_ERRORS 2
+
+// one device on the bus. Only the task that owns the device may call the
+// transfer functions on it, a step down swaps the handle underneath
+typedef struct {
+    i2c_master_bus_handle_t bus;    // NULL: speed is fixed, never stepped down
+    i2c_master_dev_handle_t handle;
+    uint16_t addr;
+    uint32_t scl_hz;                // current speed
+    uint32_t timeout_ms;            // per transfer, I2C_BUS_TIMEOUT_MS unless changed
+    uint8_t verified;               // a transfer has succeeded at scl_hz
+    uint32_t window, window_errors; // transfers and failures in the current window
+    uint32_t nacks, timeouts;       // failed transfers since the device was added
+    uint32_t step_downs;
+} i2c_bus_dev_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// create the bus on I2C_BUS_PORT, or return the one already created there
+esp_err_t i2c_bus_init(i2c_master_bus_handle_t *ret_bus);
+
+// add a device at max_hz; the first transfers confirm the speed and it is
+// stepped down whenever they fail
+esp_err_t i2c_bus_add(i2c_master_bus_handle_t bus, uint16_t addr, uint32_t max_hz, i2c_bus_dev_t *dev);
+
+// wrap a handle created elsewhere; its speed stays as configured, scl_hz
+// only records it (0 if unknown)
+void i2c_bus_attach(i2c_bus_dev_t *dev, i2c_master_dev_handle_t handle, uint32_t scl_hz);
+
+esp_err_t i2c_bus_transmit(i2c_bus_dev_t *dev, const uint8_t *data, size_t len);
+esp_err_t i2c_bus_receive(i2c_bus_dev_t *dev, uint8_t *data, size_t len);
+esp_err_t i2c_bus_transmit_receive(i2c_bus_dev_t *dev, const uint8_t *tx, size_t tx_len,
+                                   uint8_t *rx, size_t rx_len);
+
+// a read the device answers with a NACK until it has data, e.g. a sensor
+// still converting; those NACKs are expected and never cost a step down
+esp_err_t i2c_bus_poll(i2c_bus_dev_t *dev, uint8_t *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __I2C_BUS_H__
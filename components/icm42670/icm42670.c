@@ -0,0 +1,54 @@
+/*!
+ * @file icm42670.c
+ * @brief ICM-42670-P accelerometer/gyroscope with burst reads
+ */
+
+#include "esp_log.h"
+#include "icm42670.h"
+
+static const char *TAG = "icm42670";
+
+esp_err_t icm42670_init(icm42670_t *sensor, i2c_master_bus_handle_t bus) {
+    return i2c_bus_add(bus, ICM42670_ADDR, I2C_BUS_FAST_HZ, &sensor->dev);
+}
+
+esp_err_t icm42670_write_reg(icm42670_t *sensor, uint8_t reg, uint8_t value) {
+    uint8_t buf[2] = {reg, value};
+    return i2c_bus_transmit(&sensor->dev, buf, sizeof(buf));
+}
+
+esp_err_t icm42670_read_regs(icm42670_t *sensor, uint8_t reg, uint8_t *data, size_t len) {
+    esp_err_t err = i2c_bus_transmit_receive(&sensor->dev, &reg, 1, data, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "read of 0x%02x failed: %s", reg, esp_err_to_name(err));
+    }
+    return err;
+}
+
+static int16_t be16(const uint8_t *data) {
+    return (int16_t)((data[0] << 8) | data[1]);
+}
+
+static void decode_axes(const uint8_t *data, icm42670_axes_t *axes) {
+    axes->x = be16(&data[0]);
+    axes->y = be16(&data[2]);
+    axes->z = be16(&data[4]);
+}
+
+esp_err_t icm42670_read_accel(icm42670_t *sensor, icm42670_axes_t *accel) {
+    uint8_t data[6];
+    esp_err_t err = icm42670_read_regs(sensor, ICM42670_ACCEL_DATA_X1, data, sizeof(data));
+    if (err == ESP_OK) decode_axes(data, accel);
+    return err;
+}
+
+esp_err_t icm42670_read(icm42670_t *sensor, icm42670_sample_t *sample) {
+    // TEMP_DATA1..0, ACCEL_DATA_X1..Z0, GYRO_DATA_X1..Z0 are contiguous
+    uint8_t data[14];
+    esp_err_t err = icm42670_read_regs(sensor, ICM42670_TEMP_DATA1, data, sizeof(data));
+    if (err != ESP_OK) return err;
+    sample->temperature = be16(&data[0]);
+    decode_axes(&data[2], &sample->accel);
+    decode_axes(&data[8], &sample->gyro);
+    return ESP_OK;
+}
@@ -0,0 +1,74 @@
+/*!
+ * @file icm42670.h
+ * @brief ICM-42670-P accelerometer/gyroscope on the shared I2C bus, with the
+ *        output registers read in one burst so every axis of a sample comes
+ *        from the same measurement
+ */
+
+#ifndef __ICM42670_H__
+#define __ICM42670_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "i2c_bus.h"
+
+#define ICM42670_ADDR 0x68
+
+// bank 0 registers
+#define ICM42670_TEMP_DATA1   0x09
+#define ICM42670_ACCEL_DATA_X1 0x0B  // X1 X0 Y1 Y0 Z1 Z0, big endian
+#define ICM42670_GYRO_DATA_X1 0x11
+#define ICM42670_PWR_MGMT0    0x1F
+#define ICM42670_ACCEL_CONFIG0 0x21
+#define ICM42670_ACCEL_CONFIG1 0x24
+
+// what an output register reads while its sensor is off
+#define ICM42670_INVALID -32768
+
+typedef struct {
+    int16_t x, y, z;
+} icm42670_axes_t;
+
+// TEMP_DATA1 through GYRO_DATA_Z0, raw
+typedef struct {
+    int16_t temperature;
+    icm42670_axes_t accel;
+    icm42670_axes_t gyro;
+} icm42670_sample_t;
+
+typedef struct {
+    i2c_bus_dev_t dev;
+} icm42670_t;
+
+// raw temperature to hundredths of a degree, rounded: 25 C plus raw / 128
+static inline int32_t icm42670_temperature_cC(int16_t raw) {
+    return 2500 + ((raw * 25 + 16) >> 5);
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// add the sensor to the bus at fast mode
+esp_err_t icm42670_init(icm42670_t *sensor, i2c_master_bus_handle_t bus);
+
+esp_err_t icm42670_write_reg(icm42670_t *sensor, uint8_t reg, uint8_t value);
+
+// len registers from reg on, in one write-restart-read transaction; the
+// register address auto-increments
+esp_err_t icm42670_read_regs(icm42670_t *sensor, uint8_t reg, uint8_t *data, size_t len);
+
+// the three acceleration axes in one 6-byte burst. The sensor holds its
+// output registers for the length of a burst, so the high and low bytes and
+// the axes all belong to one sample
+esp_err_t icm42670_read_accel(icm42670_t *sensor, icm42670_axes_t *accel);
+
+// temperature, acceleration and rotation of one sample in one 14-byte burst.
+// Axes of a sensor that is off read ICM42670_INVALID
+esp_err_t icm42670_read(icm42670_t *sensor, icm42670_sample_t *sample);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ICM42670_H__
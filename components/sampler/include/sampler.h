@@ -0,0 +1,64 @@
+/*!
+ * @file sampler.h
+ * @brief Background sampling task for one sensor: it reads on its own
+ *        cadence and publishes the latest sample through a seqlock, so any
+ *        task gets the freshest reading without touching the bus
+ */
+
+#ifndef __SAMPLER_H__
+#define __SAMPLER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// largest sample a sampler carries, enough for any of our sensors' structs
+#define SAMPLER_MAX_SIZE 16
+#define SAMPLER_TASK_STACK 3072
+#define SAMPLER_TASK_PRIORITY (tskIDLE_PRIORITY + 2)
+
+// take one sample into sample, which is config.size bytes
+typedef esp_err_t (*sampler_read_t)(void *ctx, void *sample);
+
+typedef struct {
+    const char *name;           // task name
+    sampler_read_t read;
+    void *ctx;
+    size_t size;
+    uint32_t period_ms;         // 0: back to back, paced by read() blocking
+    UBaseType_t priority;       // 0 for SAMPLER_TASK_PRIORITY
+} sampler_config_t;
+
+typedef struct {
+    sampler_config_t config;
+    TaskHandle_t task;
+    uint32_t errors;            // read() failures, nothing was published for them
+
+    // seqlock: seq is odd while the writer updates the slot, and advances
+    // by two per published sample
+    uint32_t seq;
+    int64_t timestamp_us;
+    uint8_t data[SAMPLER_MAX_SIZE];
+    portMUX_TYPE lock;          // keeps the writer from being preempted mid-update
+} sampler_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t sampler_start(sampler_t *sampler, const sampler_config_t *config);
+
+// copy the freshest sample, false if none was published yet. Never blocks:
+// a reader only retries if a new sample landed while it was copying.
+// timestamp_us (esp_timer time the sample was published) and sequence (1 for
+// the first sample, then counting up) may be NULL
+bool sampler_latest(sampler_t *sampler, void *sample, int64_t *timestamp_us, uint32_t *sequence);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SAMPLER_H__
@@ -0,0 +1,78 @@
+/*!
+ * @file sampler.c
+ * @brief Background sampling task publishing through a seqlock
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sampler.h"
+
+static const char *TAG = "sampler";
+
+// the writer runs with preemption off, so on one core a reader never sees
+// the slot half written; on two it spins for the few cycles of the copy
+static void publish(sampler_t *sampler, const void *sample) {
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&sampler->lock);
+    uint32_t seq = sampler->seq;
+    __atomic_store_n(&sampler->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(sampler->data, sample, sampler->config.size);
+    sampler->timestamp_us = now;
+    __atomic_store_n(&sampler->seq, seq + 2, __ATOMIC_RELEASE);
+    taskEXIT_CRITICAL(&sampler->lock);
+}
+
+static void sampler_task(void *arg) {
+    sampler_t *sampler = (sampler_t *)arg;
+    const TickType_t period = pdMS_TO_TICKS(sampler->config.period_ms);
+    uint64_t sample[SAMPLER_MAX_SIZE / sizeof(uint64_t)];     // aligned for any sample struct
+    TickType_t last = xTaskGetTickCount();
+
+    for (;;) {
+        if (sampler->config.read(sampler->config.ctx, sample) == ESP_OK) {
+            publish(sampler, sample);
+        } else {
+            sampler->errors++;
+        }
+        if (sampler->config.period_ms) {
+            // at least one tick, shorter periods run at the tick rate
+            xTaskDelayUntil(&last, period ? period : 1);
+        }
+    }
+}
+
+esp_err_t sampler_start(sampler_t *sampler, const sampler_config_t *config) {
+    if (config->read == NULL || config->size == 0 || config->size > SAMPLER_MAX_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(sampler, 0, sizeof(*sampler));
+    sampler->config = *config;
+    portMUX_INITIALIZE(&sampler->lock);
+
+    UBaseType_t priority = config->priority ? config->priority : SAMPLER_TASK_PRIORITY;
+    if (xTaskCreate(sampler_task, config->name, SAMPLER_TASK_STACK, sampler, priority,
+                    &sampler->task) != pdPASS) {
+        ESP_LOGE(TAG, "failed to start %s", config->name);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool sampler_latest(sampler_t *sampler, void *sample, int64_t *timestamp_us, uint32_t *sequence) {
+    for (;;) {
+        uint32_t begin = __atomic_load_n(&sampler->seq, __ATOMIC_ACQUIRE);
+        if (begin == 0) return false;
+        if (begin & 1) continue;
+
+        memcpy(sample, sampler->data, sampler->config.size);
+        int64_t timestamp = sampler->timestamp_us;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&sampler->seq, __ATOMIC_RELAXED) != begin) continue;
+
+        if (timestamp_us) *timestamp_us = timestamp;
+        if (sequence) *sequence = begin / 2;
+        return true;
+    }
+}
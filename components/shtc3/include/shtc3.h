@@ -0,0 +1,187 @@
+/*!
+ * @file shtc3.h
+ * @brief SHTC3 temperature/humidity sensor on the shared I2C bus, with the
+ *        measurement split so the caller is free during the conversion
+ */
+
+#ifndef __SHTC3_H__
+#define __SHTC3_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "i2c_bus.h"
+
+#define SHTC3_ADDR 0x70
+
+// commands
+#define SHTC3_CMD_WAKEUP  0x3517
+#define SHTC3_CMD_MEASURE 0x7CA2    // normal mode, temperature first, clock stretching
+#define SHTC3_CMD_MEASURE_POLL 0x7866   // the same without clock stretching
+#define SHTC3_CMD_MEASURE_LP 0x6458     // low power mode, temperature first, clock stretching
+#define SHTC3_CMD_MEASURE_LP_POLL 0x609C    // the same without clock stretching
+#define SHTC3_CMD_SLEEP   0xB098
+
+// datasheet maxima
+#define SHTC3_WAKEUP_US  240
+#define SHTC3_MEASURE_US 12100
+#define SHTC3_MEASURE_LP_US 800
+
+// polling mode: first read attempt just before the typical conversion time
+// (10.8 ms, 0.7 ms in low power mode), then one every interval until the
+// timeout
+#define SHTC3_POLL_FIRST_US    10000
+#define SHTC3_POLL_INTERVAL_US 500
+#define SHTC3_POLL_TIMEOUT_US  20000
+#define SHTC3_POLL_LP_FIRST_US    600
+#define SHTC3_POLL_LP_INTERVAL_US 100
+#define SHTC3_POLL_LP_TIMEOUT_US  2000
+
+// waits this short are spun rather than slept
+#define SHTC3_SPIN_US 200
+
+// conversion latency histogram, start to data in hand
+#define SHTC3_LATENCY_BIN_US 500
+#define SHTC3_LATENCY_BINS 32
+
+// SHTC3_POWER_ADAPTIVE stays awake while samples come closer together than
+// this. Idle the sensor draws ~45 uA over its sleep current; a wakeup costs
+// the sleep and wakeup transactions plus SHTC3_WAKEUP_US of CPU spin at tens
+// of mA, which matches ~0.1 s of idling
+#define SHTC3_AWAKE_BREAK_EVEN_US 100000
+// weight of the newest interval in the average, as a shift (1/4)
+#define SHTC3_INTERVAL_SHIFT 2
+
+// every 16-bit word is followed by its CRC-8, polynomial 0x31 starting at 0xFF
+#define SHTC3_CRC_INIT 0xFF
+// conversions shtc3_read() repeats after a sample fails its CRC
+#define SHTC3_CRC_RETRIES 2
+
+// one result in fixed point, hundredths of a degree and of a percent RH
+typedef struct {
+    int32_t temperature_cC;
+    int32_t humidity_cRH;
+} shtc3_sample_t;
+
+// floor(x / 65535) with shifts and adds, for x below 2^31
+static inline uint32_t shtc3_div65535(uint32_t x) {
+    return (x + (x >> 16) + 1) >> 16;
+}
+
+// raw words to hundredths, rounded to nearest. Matches rounding the labs'
+// -45 + 175 * raw / 65535 and 100 * raw / 65535 for every raw value; the
+// datasheet divides by 2^16, the labs have always used 65535
+static inline int32_t shtc3_temperature_cC(uint16_t raw) {
+    return -4500 + (int32_t)shtc3_div65535(17500u * raw + 32767);
+}
+
+static inline int32_t shtc3_humidity_cRH(uint16_t raw) {
+    return (int32_t)shtc3_div65535(10000u * raw + 32767);
+}
+
+// hundredths to the nearest whole degree or percent, halves away from zero
+static inline int32_t shtc3_round_centi(int32_t centi) {
+    return (centi < 0 ? centi - 50 : centi + 50) / 100;
+}
+
+typedef enum {
+    SHTC3_MODE_POLL,        // no clock stretching, read attempts until the data is there
+    SHTC3_MODE_STRETCH,     // one read after the worst case conversion time, the sensor
+                            // stretches the clock if it is still busy
+} shtc3_mode_t;
+
+// what happens to the sensor between samples
+typedef enum {
+    SHTC3_POWER_ADAPTIVE,   // stays awake while samples come faster than the break-even
+    SHTC3_POWER_SLEEP,      // sleep/wakeup around each sample
+    SHTC3_POWER_AWAKE,      // never sleeps, back-to-back sampling
+} shtc3_power_t;
+
+typedef struct {
+    i2c_bus_dev_t dev;
+    shtc3_mode_t mode;
+    bool low_power;         // ~1 ms conversions, with more noise
+    shtc3_power_t power;
+    bool awake;             // the sensor was left awake after the last sample
+    int64_t awake_since;    // esp_timer time of the last wakeup
+    int64_t last_start;     // esp_timer time of the previous measurement start
+    uint32_t interval_us;   // moving average of the time between starts, 0 until known
+    int64_t started_at;     // esp_timer time of the measure command
+    int64_t ready_at;       // next time collecting is worth a try, 0 if nothing runs
+    esp_timer_handle_t timer;   // wakes a task blocked in shtc3_wait()
+    SemaphoreHandle_t wake;
+    uint32_t samples;       // results that passed the CRC check
+    uint32_t crc_errors;    // results dropped for a bad CRC
+    uint32_t read_errors;   // results the bus failed to deliver
+    uint32_t polls;         // read attempts the sensor refused while converting
+    uint32_t transactions;  // bus transfers of any kind, the cost of the samples
+    uint32_t wakeups;
+    int64_t awake_us;       // time spent awake up to the last sleep, see shtc3_awake_time_us()
+    uint32_t latency_min_us, latency_max_us;
+    uint32_t latency_hist[SHTC3_LATENCY_BINS];  // the last bin takes everything slower
+} shtc3_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// add the sensor to the bus at fast mode.
+// Measurements use SHTC3_MODE_POLL until shtc3_set_mode() says otherwise
+esp_err_t shtc3_init(shtc3_t *sensor, i2c_master_bus_handle_t bus);
+
+void shtc3_set_mode(shtc3_t *sensor, shtc3_mode_t mode);
+
+// low power measurements: a conversion takes under SHTC3_MEASURE_LP_US
+// instead of SHTC3_MEASURE_US, at the cost of repeatability
+void shtc3_set_low_power(shtc3_t *sensor, bool low_power);
+
+// power policy between samples. Staying awake saves the sleep and wakeup
+// commands plus the wakeup time on each sample; SHTC3_POWER_ADAPTIVE (the
+// default) does so while the average time between measurement starts is
+// under SHTC3_AWAKE_BREAK_EVEN_US. An idle awake sensor is put to sleep
+// when the policy changes to SHTC3_POWER_SLEEP
+esp_err_t shtc3_set_power(shtc3_t *sensor, shtc3_power_t power);
+
+// wake the sensor if needed and start a conversion, returns as soon as the
+// command is out; the result is ready SHTC3_MEASURE_US later (low power:
+// SHTC3_MEASURE_LP_US)
+esp_err_t shtc3_start_measurement(shtc3_t *sensor);
+
+// whether shtc3_collect() is worth calling
+bool shtc3_ready(const shtc3_t *sensor);
+
+// block the calling task until shtc3_collect() is worth calling: the end of
+// the conversion, or the next read attempt in polling mode
+void shtc3_wait(shtc3_t *sensor);
+
+// read the result and put the sensor back to sleep, unless the power policy
+// keeps it awake. ESP_ERR_NOT_FINISHED if the conversion is still running
+// (in polling mode: the sensor said so), ESP_ERR_INVALID_STATE if none was
+// started, ESP_ERR_INVALID_CRC if either word arrived corrupted. The sample
+// is only written on ESP_OK
+esp_err_t shtc3_collect(shtc3_t *sensor, shtc3_sample_t *sample);
+
+// wait and collect until the running conversion has an outcome
+esp_err_t shtc3_finish(shtc3_t *sensor, shtc3_sample_t *sample);
+
+// start, wait and collect in one call, with a fresh conversion for up to
+// SHTC3_CRC_RETRIES corrupted samples
+esp_err_t shtc3_read(shtc3_t *sensor, shtc3_sample_t *sample);
+
+// zero the error and cost counters and the latency statistics
+void shtc3_reset_stats(shtc3_t *sensor);
+
+// time spent awake since the last reset, including the current stretch
+int64_t shtc3_awake_time_us(const shtc3_t *sensor);
+
+// CRC-8 of a word as the sensor computes it
+uint8_t shtc3_crc8(const uint8_t *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SHTC3_H__
@@ -0,0 +1,287 @@
+/*!
+ * @file shtc3.c
+ * @brief SHTC3 temperature/humidity sensor with a split start/collect API
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "freertos/task.h"
+#include "shtc3.h"
+
+static const char *TAG = "shtc3";
+
+// CRC-8 with polynomial 0x31 (x^8 + x^5 + x^4 + 1), one entry per byte value
+static const uint8_t s_crc8[256] = {
+    0x00, 0x31, 0x62, 0x53, 0xc4, 0xf5, 0xa6, 0x97, 0xb9, 0x88, 0xdb, 0xea, 0x7d, 0x4c, 0x1f, 0x2e,
+    0x43, 0x72, 0x21, 0x10, 0x87, 0xb6, 0xe5, 0xd4, 0xfa, 0xcb, 0x98, 0xa9, 0x3e, 0x0f, 0x5c, 0x6d,
+    0x86, 0xb7, 0xe4, 0xd5, 0x42, 0x73, 0x20, 0x11, 0x3f, 0x0e, 0x5d, 0x6c, 0xfb, 0xca, 0x99, 0xa8,
+    0xc5, 0xf4, 0xa7, 0x96, 0x01, 0x30, 0x63, 0x52, 0x7c, 0x4d, 0x1e, 0x2f, 0xb8, 0x89, 0xda, 0xeb,
+    0x3d, 0x0c, 0x5f, 0x6e, 0xf9, 0xc8, 0x9b, 0xaa, 0x84, 0xb5, 0xe6, 0xd7, 0x40, 0x71, 0x22, 0x13,
+    0x7e, 0x4f, 0x1c, 0x2d, 0xba, 0x8b, 0xd8, 0xe9, 0xc7, 0xf6, 0xa5, 0x94, 0x03, 0x32, 0x61, 0x50,
+    0xbb, 0x8a, 0xd9, 0xe8, 0x7f, 0x4e, 0x1d, 0x2c, 0x02, 0x33, 0x60, 0x51, 0xc6, 0xf7, 0xa4, 0x95,
+    0xf8, 0xc9, 0x9a, 0xab, 0x3c, 0x0d, 0x5e, 0x6f, 0x41, 0x70, 0x23, 0x12, 0x85, 0xb4, 0xe7, 0xd6,
+    0x7a, 0x4b, 0x18, 0x29, 0xbe, 0x8f, 0xdc, 0xed, 0xc3, 0xf2, 0xa1, 0x90, 0x07, 0x36, 0x65, 0x54,
+    0x39, 0x08, 0x5b, 0x6a, 0xfd, 0xcc, 0x9f, 0xae, 0x80, 0xb1, 0xe2, 0xd3, 0x44, 0x75, 0x26, 0x17,
+    0xfc, 0xcd, 0x9e, 0xaf, 0x38, 0x09, 0x5a, 0x6b, 0x45, 0x74, 0x27, 0x16, 0x81, 0xb0, 0xe3, 0xd2,
+    0xbf, 0x8e, 0xdd, 0xec, 0x7b, 0x4a, 0x19, 0x28, 0x06, 0x37, 0x64, 0x55, 0xc2, 0xf3, 0xa0, 0x91,
+    0x47, 0x76, 0x25, 0x14, 0x83, 0xb2, 0xe1, 0xd0, 0xfe, 0xcf, 0x9c, 0xad, 0x3a, 0x0b, 0x58, 0x69,
+    0x04, 0x35, 0x66, 0x57, 0xc0, 0xf1, 0xa2, 0x93, 0xbd, 0x8c, 0xdf, 0xee, 0x79, 0x48, 0x1b, 0x2a,
+    0xc1, 0xf0, 0xa3, 0x92, 0x05, 0x34, 0x67, 0x56, 0x78, 0x49, 0x1a, 0x2b, 0xbc, 0x8d, 0xde, 0xef,
+    0x82, 0xb3, 0xe0, 0xd1, 0x46, 0x77, 0x24, 0x15, 0x3b, 0x0a, 0x59, 0x68, 0xff, 0xce, 0x9d, 0xac,
+};
+
+uint8_t shtc3_crc8(const uint8_t *data, size_t len) {
+    uint8_t crc = SHTC3_CRC_INIT;
+    for (size_t i = 0; i < len; i++) {
+        crc = s_crc8[crc ^ data[i]];
+    }
+    return crc;
+}
+
+// measure commands and timing of one precision
+typedef struct {
+    uint16_t measure, measure_poll;
+    uint32_t measure_us;
+    uint32_t poll_first_us, poll_interval_us, poll_timeout_us;
+} timing_t;
+
+static const timing_t s_normal = {
+    SHTC3_CMD_MEASURE, SHTC3_CMD_MEASURE_POLL, SHTC3_MEASURE_US,
+    SHTC3_POLL_FIRST_US, SHTC3_POLL_INTERVAL_US, SHTC3_POLL_TIMEOUT_US,
+};
+
+static const timing_t s_low_power = {
+    SHTC3_CMD_MEASURE_LP, SHTC3_CMD_MEASURE_LP_POLL, SHTC3_MEASURE_LP_US,
+    SHTC3_POLL_LP_FIRST_US, SHTC3_POLL_LP_INTERVAL_US, SHTC3_POLL_LP_TIMEOUT_US,
+};
+
+static const timing_t *timing(const shtc3_t *sensor) {
+    return sensor->low_power ? &s_low_power : &s_normal;
+}
+
+static esp_err_t write_command(shtc3_t *sensor, uint16_t command) {
+    uint8_t data[2] = {command >> 8, command & 0xFF};
+    sensor->transactions++;
+    return i2c_bus_transmit(&sensor->dev, data, sizeof(data));
+}
+
+static void wake_waiter(void *arg) {
+    xSemaphoreGive(((shtc3_t *)arg)->wake);
+}
+
+esp_err_t shtc3_init(shtc3_t *sensor, i2c_master_bus_handle_t bus) {
+    memset(sensor, 0, sizeof(*sensor));
+    sensor->mode = SHTC3_MODE_POLL;
+    sensor->power = SHTC3_POWER_ADAPTIVE;
+    shtc3_reset_stats(sensor);
+
+    sensor->wake = xSemaphoreCreateBinary();
+    if (sensor->wake == NULL) return ESP_ERR_NO_MEM;
+    esp_timer_create_args_t timer_args = {
+        .callback = wake_waiter,
+        .arg = sensor,
+        .name = "shtc3",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &sensor->timer);
+    if (err != ESP_OK) return err;
+
+    return i2c_bus_add(bus, SHTC3_ADDR, I2C_BUS_FAST_HZ, &sensor->dev);
+}
+
+void shtc3_set_mode(shtc3_t *sensor, shtc3_mode_t mode) {
+    sensor->mode = mode;
+}
+
+void shtc3_set_low_power(shtc3_t *sensor, bool low_power) {
+    sensor->low_power = low_power;
+}
+
+static void mark_asleep(shtc3_t *sensor) {
+    if (sensor->awake) sensor->awake_us += esp_timer_get_time() - sensor->awake_since;
+    sensor->awake = false;
+}
+
+esp_err_t shtc3_set_power(shtc3_t *sensor, shtc3_power_t power) {
+    sensor->power = power;
+    if (power != SHTC3_POWER_SLEEP || !sensor->awake || sensor->ready_at != 0) return ESP_OK;
+    mark_asleep(sensor);
+    return write_command(sensor, SHTC3_CMD_SLEEP);
+}
+
+// after a failure the sensor's state is unknown, the next start wakes it
+static void go_to_sleep(shtc3_t *sensor) {
+    mark_asleep(sensor);
+    write_command(sensor, SHTC3_CMD_SLEEP);
+}
+
+// whether the sample just taken should leave the sensor awake
+static bool keep_awake(const shtc3_t *sensor) {
+    switch (sensor->power) {
+    case SHTC3_POWER_AWAKE:
+        return true;
+    case SHTC3_POWER_ADAPTIVE:
+        // the next sample is expected as far off as the recent ones were
+        return sensor->interval_us != 0 && sensor->interval_us < SHTC3_AWAKE_BREAK_EVEN_US;
+    default:
+        return false;
+    }
+}
+
+// moving average of the time between measurement starts
+static void track_interval(shtc3_t *sensor, int64_t now) {
+    int64_t last = sensor->last_start;
+    sensor->last_start = now;
+    if (last == 0) return;
+
+    int64_t interval = now - last;
+    if (interval > UINT32_MAX) interval = UINT32_MAX;
+    if (sensor->interval_us == 0) {
+        sensor->interval_us = interval;
+    } else {
+        sensor->interval_us += (interval - (int64_t)sensor->interval_us) >> SHTC3_INTERVAL_SHIFT;
+    }
+}
+
+esp_err_t shtc3_start_measurement(shtc3_t *sensor) {
+    const timing_t *t = timing(sensor);
+    esp_err_t err;
+    track_interval(sensor, esp_timer_get_time());
+    if (!sensor->awake) {
+        sensor->wakeups++;
+        err = write_command(sensor, SHTC3_CMD_WAKEUP);
+        if (err != ESP_OK) return err;
+        sensor->awake_since = esp_timer_get_time();
+        // too short to be worth a context switch
+        esp_rom_delay_us(SHTC3_WAKEUP_US);
+        sensor->awake = true;
+    }
+
+    bool poll = sensor->mode == SHTC3_MODE_POLL;
+    err = write_command(sensor, poll ? t->measure_poll : t->measure);
+    if (err != ESP_OK) {
+        go_to_sleep(sensor);
+        return err;
+    }
+    sensor->started_at = esp_timer_get_time();
+    sensor->ready_at = sensor->started_at + (poll ? t->poll_first_us : t->measure_us);
+    return ESP_OK;
+}
+
+bool shtc3_ready(const shtc3_t *sensor) {
+    return sensor->ready_at != 0 && esp_timer_get_time() >= sensor->ready_at;
+}
+
+// a one-shot esp_timer wakes the task, sleeping whole ticks would overshoot
+// the conversion by up to a tick
+void shtc3_wait(shtc3_t *sensor) {
+    if (sensor->ready_at == 0) return;
+    int64_t remaining = sensor->ready_at - esp_timer_get_time();
+    if (remaining <= 0) return;
+    if (remaining <= SHTC3_SPIN_US) {
+        esp_rom_delay_us(remaining);
+        return;
+    }
+    xSemaphoreTake(sensor->wake, 0);    // a give left over from an abandoned wait
+    if (esp_timer_start_once(sensor->timer, remaining) != ESP_OK) {
+        vTaskDelay(pdMS_TO_TICKS(remaining / 1000) + 1);
+        return;
+    }
+    xSemaphoreTake(sensor->wake, portMAX_DELAY);
+}
+
+static void record_latency(shtc3_t *sensor, uint32_t latency_us) {
+    uint32_t bin = latency_us / SHTC3_LATENCY_BIN_US;
+    sensor->latency_hist[bin < SHTC3_LATENCY_BINS ? bin : SHTC3_LATENCY_BINS - 1]++;
+    if (latency_us < sensor->latency_min_us) sensor->latency_min_us = latency_us;
+    if (latency_us > sensor->latency_max_us) sensor->latency_max_us = latency_us;
+}
+
+esp_err_t shtc3_collect(shtc3_t *sensor, shtc3_sample_t *sample) {
+    if (sensor->ready_at == 0) return ESP_ERR_INVALID_STATE;
+    if (!shtc3_ready(sensor)) return ESP_ERR_NOT_FINISHED;
+
+    // temp MSB, temp LSB, checksum, hum MSB, hum LSB, checksum
+    const timing_t *t = timing(sensor);
+    uint8_t data[6];
+    esp_err_t err;
+    if (sensor->mode == SHTC3_MODE_POLL) {
+        // the sensor NACKs its address until the conversion is done
+        sensor->transactions++;
+        err = i2c_bus_poll(&sensor->dev, data, sizeof(data));
+        if (err != ESP_OK && err != ESP_ERR_TIMEOUT) {
+            int64_t now = esp_timer_get_time();
+            if (now - sensor->started_at < t->poll_timeout_us) {
+                sensor->polls++;
+                sensor->ready_at = now + t->poll_interval_us;
+                return ESP_ERR_NOT_FINISHED;
+            }
+            err = ESP_ERR_TIMEOUT;
+        }
+    } else {
+        sensor->transactions++;
+        err = i2c_bus_receive(&sensor->dev, data, sizeof(data));
+    }
+    sensor->ready_at = 0;
+    if (err == ESP_OK) {
+        record_latency(sensor, esp_timer_get_time() - sensor->started_at);
+    }
+    if (err == ESP_OK && (shtc3_crc8(&data[0], 2) != data[2] || shtc3_crc8(&data[3], 2) != data[5])) {
+        err = ESP_ERR_INVALID_CRC;
+    }
+    if (err == ESP_OK) {
+        sensor->samples++;
+        sample->temperature_cC = shtc3_temperature_cC((data[0] << 8) | data[1]);
+        sample->humidity_cRH = shtc3_humidity_cRH((data[3] << 8) | data[4]);
+    } else if (err == ESP_ERR_INVALID_CRC) {
+        sensor->crc_errors++;
+        ESP_LOGW(TAG, "sample failed its CRC check, dropped");
+    } else {
+        sensor->read_errors++;
+        ESP_LOGE(TAG, "read failed: %s", esp_err_to_name(err));
+    }
+
+    if (err == ESP_OK && keep_awake(sensor)) return err;
+    go_to_sleep(sensor);
+    return err;
+}
+
+void shtc3_reset_stats(shtc3_t *sensor) {
+    sensor->samples = 0;
+    sensor->crc_errors = 0;
+    sensor->read_errors = 0;
+    sensor->polls = 0;
+    sensor->transactions = 0;
+    sensor->wakeups = 0;
+    sensor->awake_us = 0;
+    sensor->awake_since = esp_timer_get_time();
+    sensor->latency_min_us = UINT32_MAX;
+    sensor->latency_max_us = 0;
+    memset(sensor->latency_hist, 0, sizeof(sensor->latency_hist));
+}
+
+int64_t shtc3_awake_time_us(const shtc3_t *sensor) {
+    int64_t awake_us = sensor->awake_us;
+    if (sensor->awake) awake_us += esp_timer_get_time() - sensor->awake_since;
+    return awake_us;
+}
+
+esp_err_t shtc3_finish(shtc3_t *sensor, shtc3_sample_t *sample) {
+    esp_err_t err;
+    do {
+        shtc3_wait(sensor);
+        err = shtc3_collect(sensor, sample);
+    } while (err == ESP_ERR_NOT_FINISHED);
+    return err;
+}
+
+esp_err_t shtc3_read(shtc3_t *sensor, shtc3_sample_t *sample) {
+    esp_err_t err;
+    int attempts = 0;
+    do {
+        err = shtc3_start_measurement(sensor);
+        if (err != ESP_OK) return err;
+        err = shtc3_finish(sensor, sample);
+    } while (err == ESP_ERR_INVALID_CRC && ++attempts <= SHTC3_CRC_RETRIES);
+    return err;
+}
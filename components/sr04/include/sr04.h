@@ -0,0 +1,54 @@
+/*!
+ * @file sr04.h
+ * @brief HC-SR04 ultrasonic ranging, with the echo to distance conversion in
+ *        integer fixed point
+ */
+
+#ifndef __SR04_H__
+#define __SR04_H__
+
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "esp_err.h"
+
+#define SR04_TRIGGER_US 10
+#define SR04_TIMEOUT_US 30000       // per echo edge
+
+// speed of sound in hundredths of a mm/s: 331.3 m/s at 0 C plus 0.606 m/s
+// per degree, i.e. 6.06 per hundredth of a degree
+#define SR04_SOUND_BASE 33130000
+#define SR04_SOUND_PER_CC 606
+
+// longest echo sr04_distance_mm() converts exactly
+#define SR04_MAX_ECHO_US 50000
+
+typedef struct {
+    gpio_num_t trig;
+    gpio_num_t echo;
+} sr04_t;
+
+// distance in mm for an echo of echo_us at temperature_cC hundredths of a
+// degree, rounded to nearest: echo * speed / 2, with the final division by
+// 2e8 split into a shift and a 32-bit division by a constant the compiler
+// turns into a multiply
+static inline uint32_t sr04_distance_mm(uint32_t echo_us, int32_t temperature_cC) {
+    uint32_t speed = SR04_SOUND_BASE + SR04_SOUND_PER_CC * temperature_cC;
+    uint64_t twice = (uint64_t)echo_us * speed + 100000000;
+    return (uint32_t)(twice >> 9) / 390625u;
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t sr04_init(sr04_t *sensor, gpio_num_t trig, gpio_num_t echo);
+
+// fire one ping and time the echo pulse, ESP_ERR_TIMEOUT if either of its
+// edges does not come within SR04_TIMEOUT_US
+esp_err_t sr04_echo_us(const sr04_t *sensor, uint32_t *echo_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SR04_H__
@@ -0,0 +1,57 @@
+/*!
+ * @file sr04.c
+ * @brief HC-SR04 ultrasonic ranging
+ */
+
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "sr04.h"
+
+static const char *TAG = "sr04";
+
+esp_err_t sr04_init(sr04_t *sensor, gpio_num_t trig, gpio_num_t echo) {
+    sensor->trig = trig;
+    sensor->echo = echo;
+
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 1ULL << trig,
+        .mode = GPIO_MODE_OUTPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+    esp_err_t err = gpio_config(&io_conf);
+    if (err != ESP_OK) return err;
+
+    io_conf.pin_bit_mask = 1ULL << echo;
+    io_conf.mode = GPIO_MODE_INPUT;
+    return gpio_config(&io_conf);
+}
+
+esp_err_t sr04_echo_us(const sr04_t *sensor, uint32_t *echo_us) {
+    // Trigger ultrasonic pulse
+    gpio_set_level(sensor->trig, 1);
+    esp_rom_delay_us(SR04_TRIGGER_US);
+    gpio_set_level(sensor->trig, 0);
+
+    // Wait for Echo signal to go HIGH
+    int64_t start_time = esp_timer_get_time();
+    while (gpio_get_level(sensor->echo) == 0) {
+        if ((esp_timer_get_time() - start_time) > SR04_TIMEOUT_US) {
+            ESP_LOGW(TAG, "Echo timeout waiting for HIGH");
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+
+    // Measure the HIGH duration of Echo signal
+    start_time = esp_timer_get_time();
+    while (gpio_get_level(sensor->echo) == 1) {
+        if ((esp_timer_get_time() - start_time) > SR04_TIMEOUT_US) {
+            ESP_LOGW(TAG, "Echo timeout waiting for LOW");
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    *echo_us = esp_timer_get_time() - start_time;
+    return ESP_OK;
+}
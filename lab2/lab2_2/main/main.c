@@ -1,115 +1,99 @@
+#include <inttypes.h>
 #include <stdio.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "driver/i2c.h"
+#include "aggregate.h"
+#include "i2c_bus.h"
+#include "shtc3.h"
 
-#define I2C_MASTER_SCL_IO 8  // SCL on GPIO8
-#define I2C_MASTER_SDA_IO 10 // SDA on GPIO10
-#define I2C_MASTER_FREQ_HZ 100000  // 100kHz I2C clock
-#define I2C_MASTER_NUM I2C_NUM_0  // I2C port number
 #define TAG "I2C_SHTC3"
+#define READ_RETRY_MS 100   // back-off after a failed read, so a missing sensor cannot spin the loop
 
-#define SHTC3_ADDR 0x70  // I2C address for SHTC3 sensor
+static shtc3_t shtc3;
+static agg_t agg;   // 1 s, 1 min and 1 h windows over temperature and humidity
 
-// I2C commands
-#define WAKEUP_CMD  0x3517
-#define MEASURE_CMD 0x7CA2
-#define SLEEP_CMD   0xB098
+enum { CH_TEMPERATURE, CH_HUMIDITY };
 
 // Initialize I2C with proper configuration
 void i2c_master_init() {
-    i2c_config_t conf = {
-        .mode = I2C_MODE_MASTER,
-        .sda_io_num = I2C_MASTER_SDA_IO,
-        .scl_io_num = I2C_MASTER_SCL_IO,
-        .sda_pullup_en = GPIO_PULLUP_ENABLE,
-        .scl_pullup_en = GPIO_PULLUP_ENABLE,
-        .master.clk_speed = I2C_MASTER_FREQ_HZ  // 100kHz I2C clock
-    };
-
-    // Check and configure I2C parameters
-    ESP_ERROR_CHECK(i2c_param_config(I2C_MASTER_NUM, &conf));
-    ESP_LOGI(TAG, "I2C configuration set. SDA: GPIO%d, SCL: GPIO%d, Frequency: %d Hz",
-             I2C_MASTER_SDA_IO, I2C_MASTER_SCL_IO, I2C_MASTER_FREQ_HZ);
+    i2c_master_bus_handle_t bus;
 
-    // Install the I2C driver
-    ESP_ERROR_CHECK(i2c_driver_install(I2C_MASTER_NUM, I2C_MODE_MASTER, 0, 0, 0));
-    ESP_LOGI(TAG, "I2C driver installed successfully");
+    // shared bus on SDA GPIO10 / SCL GPIO8
+    ESP_ERROR_CHECK(i2c_bus_init(&bus));
+    ESP_ERROR_CHECK(shtc3_init(&shtc3, bus));
+    ESP_LOGI(TAG, "I2C bus ready");
 }
 
-// Function to send commands over I2C
-void write_command(uint16_t command) {
-    // command >> 8 gives MSB, command & 0xFF gives LSB
-    uint8_t data[2] = { command >> 8, command & 0xFF };
-    ESP_LOGI(TAG, "Sending command: 0x%04X", command);
-    esp_err_t ret = i2c_master_write_to_device(
-        I2C_MASTER_NUM, // I2C port number
-        SHTC3_ADDR, // I2C address of the device
-        data, // pointer to the data buffer to be written
-        sizeof(data), // size of the data to be written
-        1000 / portTICK_PERIOD_MS // timeout period
-    );
+// Function to read temperature and humidity from the sensor
+esp_err_t read_sensor(shtc3_sample_t *sample) {
+    // wake, measure, read 6 bytes and put the sensor back to sleep
+    esp_err_t ret = shtc3_read(&shtc3, sample);
 
     if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "Command 0x%04X sent successfully", command);
+        int32_t values[] = {[CH_TEMPERATURE] = sample->temperature_cC, [CH_HUMIDITY] = sample->humidity_cRH};
+        agg_add(&agg, esp_timer_get_time(), values);
     } else {
-        ESP_LOGE(TAG, "Failed to send command 0x%04X", command);
+        ESP_LOGE(TAG, "Failed to read data from sensor");
     }
+    return ret;
 }
 
-// Function to read temperature and humidity from the sensor
-void read_sensor(float *temperature_C, float *humidity) {
-    uint8_t data[6];
-    
-    // Wake up sensor
-    write_command(WAKEUP_CMD);
-    vTaskDelay(1 / portTICK_PERIOD_MS);  // small delay to ensure wakeup
-
-    // Send measurement command
-    write_command(MEASURE_CMD);
-    vTaskDelay(20 / portTICK_PERIOD_MS);  // wait for measurement to complete
-
-    // Read 6 bytes (temp MSB, temp LSB, checksum, hum MSB, hum LSB, checksum)
-    esp_err_t ret = i2c_master_read_from_device(I2C_MASTER_NUM, SHTC3_ADDR, data, 6, 1000 / portTICK_PERIOD_MS);
+static const char *const window_names[] = {"second", "minute", "hour"};
 
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "Received data from sensor");
+// one line per closed window, seconds only at debug level
+static void print_window(void *ctx, const agg_window_t *window) {
+    const agg_stats_t *t = &window->channel[CH_TEMPERATURE];
+    const agg_stats_t *h = &window->channel[CH_HUMIDITY];
 
-        // Calculate temperature in Celsius
-        uint16_t temp_raw = (data[0] << 8) | data[1];
-        *temperature_C = -45 + (175.0 * (temp_raw / 65535.0));
+    // Convert temperature to Fahrenheit, in hundredths as well
+    int32_t mean_cF = (t->mean * 9 / 5) + 3200;
 
-        // Calculate humidity
-        uint16_t hum_raw = (data[3] << 8) | data[4];
-        *humidity = 100.0 * (hum_raw / 65535.0);
-
-        ESP_LOGI(TAG, "Raw temp: %u, Temp in C: %.2f", temp_raw, *temperature_C);
-        ESP_LOGI(TAG, "Raw hum: %u, Humidity: %.2f", hum_raw, *humidity);
-    } else {
-        ESP_LOGE(TAG, "Failed to read data from sensor");
+    if (window->level == 0) {
+        ESP_LOGD(TAG, "%" PRIu32 " samples, temp %" PRId32 " cC, humidity %" PRId32 " c%%",
+                 window->count, t->mean, h->mean);
+        return;
+    }
+    printf("Last %s, %" PRIu32 " samples: temperature %" PRId32 "C (or %" PRId32 "F), "
+           "min %" PRId32 " max %" PRId32 " sd %" PRId32 ".%02" PRId32 "; "
+           "humidity %" PRId32 "%%, min %" PRId32 " max %" PRId32 " sd %" PRId32 ".%02" PRId32 "\n",
+           window_names[window->level], window->count,
+           shtc3_round_centi(t->mean), shtc3_round_centi(mean_cF),
+           shtc3_round_centi(t->min), shtc3_round_centi(t->max),
+           t->stddev / 100, t->stddev % 100,
+           shtc3_round_centi(h->mean), shtc3_round_centi(h->min), shtc3_round_centi(h->max),
+           h->stddev / 100, h->stddev % 100);
+
+    // what each sample cost over the last minute, the power policy keeps the
+    // sensor awake at this rate
+    if (window->level == 1 && shtc3.samples) {
+        uint32_t per_100 = shtc3.transactions * 100 / shtc3.samples;
+        ESP_LOGI(TAG, "%" PRIu32 ".%02" PRIu32 " transfers a sample, %" PRIu32 " wakeups in %" PRIu32 " samples, awake %" PRId64 " ms",
+                 per_100 / 100, per_100 % 100, shtc3.wakeups, shtc3.samples, shtc3_awake_time_us(&shtc3) / 1000);
+        shtc3_reset_stats(&shtc3);
     }
-
-    // Put sensor back to sleep
-    write_command(SLEEP_CMD);
 }
 
 void app_main() {
     // Initialize I2C
     i2c_master_init();
 
-    float temperature_C, humidity;
-
-    // Repeatedly read sensor values every 2 seconds
-    while (1) {
-        read_sensor(&temperature_C, &humidity);
-
-        // Convert temperature to Fahrenheit
-        float temperature_F = (temperature_C * 9 / 5) + 32;
+    agg_config_t windows = {
+        .channels = 2,
+        .levels = 3,
+        .window_us = {1000000, 60 * 1000000LL, 3600 * 1000000LL},
+        .emit = print_window,
+    };
+    ESP_ERROR_CHECK(agg_init(&agg, &windows));
 
-        // Print temperature and humidity
-        printf("Temperature is %.0fC (or %.0fF) with a %.0f%% humidity\n", temperature_C, temperature_F, humidity);
+    shtc3_sample_t sample = {0};
 
-        vTaskDelay(2000 / portTICK_PERIOD_MS);  // Wait 2 seconds before the next reading
+    // Read back to back, as fast as the sensor converts (the task blocks
+    // during each conversion); only the window summaries are printed
+    while (1) {
+        if (read_sensor(&sample) != ESP_OK) {
+            vTaskDelay(pdMS_TO_TICKS(READ_RETRY_MS));
+        }
     }
-}
\ No newline at end of file
+}
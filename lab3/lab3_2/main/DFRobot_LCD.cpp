@@ -7,11 +7,17 @@
 #include <string.h>
 #include <inttypes.h>
 #include "DFRobot_LCD.h"
-#include "driver/i2c.h"
 #include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
 
 // Constants
-#define I2C_MASTER_PORT I2C_NUM_0  // change if using a different I2C port
+
+// controller execution times, HD44780/AiP31068 datasheets at fosc = 270 kHz
+#define LCD_POWERUP_US 50000    // VDD up to the first instruction
+#define LCD_EXEC_INIT_US 4100   // first function set after power-up
+#define LCD_EXEC_CLEAR_US 1530  // clear display, return home
+#define LCD_EXEC_CMD_US 39      // every other instruction; data needs no wait
 
 const uint8_t color_define[5][3] = {
     {255, 255, 255},  // white
@@ -21,11 +27,63 @@ const uint8_t color_define[5][3] = {
     {81, 201, 245}    // bonnie blue
 };
 
+// async op types, see lcd_op_t
+enum {
+    LCD_OP_COMMAND,     // arg = instruction
+    LCD_OP_DATA,        // arg = length, data = bytes
+    LCD_OP_CGRAM,       // arg = location, data = charmap
+    LCD_OP_REG,         // arg = RGB register, data[0] = value
+    LCD_OP_RGB,         // latest color is in _pendingRGB
+    LCD_OP_FLUSH,
+};
+
 DFRobot_LCD::DFRobot_LCD(uint8_t lcd_cols, uint8_t lcd_rows, uint8_t lcd_Addr, uint8_t RGB_Addr) {
     _lcdAddr = lcd_Addr;
     _RGBAddr = RGB_Addr;
-    _cols = lcd_cols;
-    _rows = lcd_rows;
+    _cols = lcd_cols > LCD_MAX_COLS ? LCD_MAX_COLS : lcd_cols;
+    _rows = lcd_rows > LCD_MAX_ROWS ? LCD_MAX_ROWS : lcd_rows;
+    // rows 2/3 share the DDRAM lines with rows 0/1
+    if (_rows > 2 && _cols > LCD_MAX_COLS / 2) _cols = LCD_MAX_COLS / 2;
+    for (uint8_t row = 0; row < LCD_MAX_ROWS; row++) {
+        _rowOffset[row] = lcd_row_offset(_cols, row);
+    }
+    memset(_shadow, ' ', sizeof(_shadow));
+    memset(_panel, ' ', sizeof(_panel));
+    _col = 0;
+    _row = 0;
+    memset(_lineCols, _cols, sizeof(_lineCols));
+    _shift = 0;
+    _graphtype = 0;
+    _glyphCount = 0;
+    memset(_slotGlyph, -1, sizeof(_slotGlyph));
+    memset(_slotUsed, 0, sizeof(_slotUsed));
+    _glyphClock = 0;
+    _glyphHits = 0;
+    _glyphMisses = 0;
+    _readyAt = 0;
+    i2c_bus_attach(&_lcdDev, NULL, 0);
+    i2c_bus_attach(&_rgbDev, NULL, 0);
+    _rgbValid = 0;
+    _async = false;
+    _queue = NULL;
+    _lock = NULL;
+    _task = NULL;
+    _flushPending = false;
+    _rgbPending = false;
+    _droppedOps = 0;
+    memset(_cgram, 0, sizeof(_cgram));
+    memset(&_stats, 0, sizeof(_stats));
+    _resyncPending = false;
+    _refreshTimer = NULL;
+    _fps = 0;
+    _frameRequested = false;
+    _rgbDeferred = false;
+    _droppedUpdates = 0;
+    _framesDrawn = 0;
+    _fpsTicks = 0;
+    _fpsFrames = 0;
+    _fpsSince = 0;
+    _measuredFps = 0;
 }
 
 // void i2c_master_init() {
@@ -51,43 +109,170 @@ DFRobot_LCD::DFRobot_LCD(uint8_t lcd_cols, uint8_t lcd_rows, uint8_t lcd_Addr, u
 //     }
 // }
 
+// standalone setup: bring up (or join) the board's shared bus
 void DFRobot_LCD::init() {
-    // i2c_master_init();
+    i2c_master_bus_handle_t bus = NULL;
+    if (i2c_bus_init(&bus) != ESP_OK) return;
+    init(bus);
+}
 
-    // original master_init()
-    i2c_config_t conf;
-    conf.mode = I2C_MODE_MASTER;
-    conf.sda_io_num = 10;
-    conf.scl_io_num = 8;
-    conf.sda_pullup_en = GPIO_PULLUP_ENABLE;
-    conf.scl_pullup_en = GPIO_PULLUP_ENABLE;
-    conf.master.clk_speed = 100000;
-    conf.clk_flags = 0;
+// attach both controllers to a bus the application already configured,
+// starting at max_scl_hz
+void DFRobot_LCD::init(i2c_master_bus_handle_t bus, uint32_t max_scl_hz) {
+    if (i2c_bus_add(bus, _lcdAddr, max_scl_hz, &_lcdDev) != ESP_OK) return;
+    i2c_bus_add(bus, _RGBAddr, max_scl_hz, &_rgbDev);
+    _lcdDev.timeout_ms = LCD_I2C_TIMEOUT_MS;
+    _rgbDev.timeout_ms = LCD_I2C_TIMEOUT_MS;
+    _showfunction = LCD_4BITMODE | LCD_1LINE | LCD_5x8DOTS;
+    begin(_cols, _rows);
+}
+
+// use ready-made device handles; rgb may be NULL for a panel without the
+// backlight controller. The handles are created once, the write path only
+// uses them and never touches the heap
+void DFRobot_LCD::init(i2c_master_dev_handle_t lcd, i2c_master_dev_handle_t rgb) {
+    i2c_bus_attach(&_lcdDev, lcd, 0);
+    i2c_bus_attach(&_rgbDev, rgb, 0);
+    _lcdDev.timeout_ms = LCD_I2C_TIMEOUT_MS;
+    _rgbDev.timeout_ms = LCD_I2C_TIMEOUT_MS;
+    _showfunction = LCD_4BITMODE | LCD_1LINE | LCD_5x8DOTS;
+    begin(_cols, _rows);
+}
 
-    i2c_param_config(I2C_NUM_0, &conf);
+// switch to async mode: from here on the public API only records operations
+// and a render task at the given priority coalesces them onto the bus
+bool DFRobot_LCD::startAsync(UBaseType_t priority) {
+    if (_async) return true;
 
-    esp_err_t err = i2c_param_config(I2C_MASTER_PORT, &conf);
-    if (err != ESP_OK) {
-        printf("I2C configuration error: %s\n", esp_err_to_name(err));
+    _lock = xSemaphoreCreateMutex();
+    _queue = xQueueCreate(LCD_QUEUE_DEPTH, sizeof(lcd_op_t));
+    if (_lock == NULL || _queue == NULL ||
+        xTaskCreate(renderTask, "lcd_render", LCD_TASK_STACK, this, priority, &_task) != pdPASS) {
+        ESP_LOGE("LCD", "Failed to start render task");
+        if (_queue) vQueueDelete(_queue);
+        if (_lock) vSemaphoreDelete(_lock);
+        _queue = NULL;
+        _lock = NULL;
+        return false;
     }
+    _async = true;
+    return true;
+}
 
-    err = i2c_driver_install(I2C_MASTER_PORT, conf.mode, 0, 0, 0);
-    if (err != ESP_OK) {
-        printf("I2C driver install error: %s\n", esp_err_to_name(err));
+// cap panel updates at fps: from here on writes land in the shadow at any
+// rate and an esp_timer hands the latest state to the render task once per
+// period, so a tight loop no longer floods the bus. Starts async mode
+bool DFRobot_LCD::startRefresh(uint8_t fps) {
+    if (fps == 0 || !startAsync()) return false;
+    stopRefresh();
+
+    esp_timer_create_args_t args = {};
+    args.callback = refreshTimer;
+    args.arg = this;
+    args.name = "lcd_refresh";
+    args.skip_unhandled_events = true;
+    esp_timer_handle_t timer;
+    if (esp_timer_create(&args, &timer) != ESP_OK) return false;
+
+    _fps = fps;
+    _fpsTicks = 0;
+    _fpsFrames = _framesDrawn;
+    _fpsSince = esp_timer_get_time();
+    _refreshTimer = timer;
+    if (esp_timer_start_periodic(timer, 1000000 / fps) != ESP_OK) {
+        _refreshTimer = NULL;
+        esp_timer_delete(timer);
+        return false;
     }
+    return true;
+}
 
-    _showfunction = LCD_4BITMODE | LCD_1LINE | LCD_5x8DOTS;
-    begin(_cols, _rows);
+// back to flushing on every flush() call; whatever was waiting goes out now
+void DFRobot_LCD::stopRefresh() {
+    if (_refreshTimer == NULL) return;
+    esp_timer_handle_t timer = _refreshTimer;
+    _refreshTimer = NULL;
+    esp_timer_stop(timer);
+    esp_timer_delete(timer);
+    refreshTick();
+}
+
+// frames the render task applied per second, over the last second
+uint32_t DFRobot_LCD::measuredFps() {
+    return _measuredFps;
+}
+
+// flush() calls folded into a later frame without reaching the panel
+uint32_t DFRobot_LCD::droppedUpdates() {
+    return _droppedUpdates;
+}
+
+void DFRobot_LCD::refreshTimer(void *arg) {
+    static_cast<DFRobot_LCD *>(arg)->refreshTick();
+}
+
+void DFRobot_LCD::refreshTick() {
+    if (_rgbDeferred) {
+        _rgbDeferred = false;
+        lcd_op_t op = {LCD_OP_RGB, 0, {0}};
+        if (!post(op)) _rgbPending = false;
+    }
+    if (_frameRequested) {
+        _frameRequested = false;
+        postFlush();
+    }
+
+    // about once a second, from the frames the render task really drew
+    if (_fps && ++_fpsTicks >= _fps) {
+        int64_t now = esp_timer_get_time();
+        uint32_t frames = _framesDrawn;
+        if (now > _fpsSince) {
+            int64_t elapsed = now - _fpsSince;
+            _measuredFps = ((uint64_t)(frames - _fpsFrames) * 1000000 + elapsed / 2) / elapsed;
+        }
+        _fpsTicks = 0;
+        _fpsFrames = frames;
+        _fpsSince = now;
+    }
+}
+
+// operations lost because the queue was full
+uint32_t DFRobot_LCD::droppedOps() {
+    return _droppedOps;
+}
+
+lcd_stats_t DFRobot_LCD::stats() {
+    return _stats;
+}
+
+void DFRobot_LCD::resetStats() {
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+// rewrite both controllers from the driver's own state, e.g. after the
+// display was power cycled; runs with the next flush, on the render task in
+// async mode. A transaction that fails every retry schedules this by itself
+void DFRobot_LCD::resync() {
+    _resyncPending = true;
+    flush();
 }
 
 void DFRobot_LCD::clear() {
+    lock();
+    memset(_shadow, ' ', sizeof(_shadow));
+    _col = 0;
+    _row = 0;
+    memset(_lineCols, _cols, sizeof(_lineCols));
+    _shift = 0;
+    unlock();
     command(LCD_CLEARDISPLAY);
-    vTaskDelay(2 / portTICK_PERIOD_MS);
 }
 
 void DFRobot_LCD::home() {
     command(LCD_RETURNHOME);
-    vTaskDelay(2 / portTICK_PERIOD_MS);
+    _col = 0;
+    _row = 0;
+    _shift = 0;
 }
 
 void DFRobot_LCD::noDisplay() {
@@ -122,10 +307,12 @@ void DFRobot_LCD::cursor() {
 
 void DFRobot_LCD::scrollDisplayLeft(void) {
     command(LCD_CURSORSHIFT | LCD_DISPLAYMOVE | LCD_MOVELEFT);
+    _shift = (_shift + 1) % LCD_MAX_COLS;
 }
 
 void DFRobot_LCD::scrollDisplayRight(void) {
     command(LCD_CURSORSHIFT | LCD_DISPLAYMOVE | LCD_MOVERIGHT);
+    _shift = (_shift + LCD_MAX_COLS - 1) % LCD_MAX_COLS;
 }
 
 void DFRobot_LCD::leftToRight(void) {
@@ -150,26 +337,51 @@ void DFRobot_LCD::autoscroll(void) {
 
 void DFRobot_LCD::customSymbol(uint8_t location, uint8_t charmap[]) {
     location &= 0x7;  // we only have 8 locations 0-7
-    command(LCD_SETCGRAMADDR | (location << 3));
+    _graphtype = 0;   // whatever bargraph set was loaded is gone
+    _slotGlyph[location] = -1;
+    uploadSlot(location, charmap);
+}
 
-    uint8_t data[9];
-    data[0] = 0x40;
-    for (int i = 0; i < 8; i++) {
-        data[i + 1] = charmap[i];
+// write one CGRAM slot and our copy of it; the bargraph and glyph
+// bookkeeping is left to the caller
+void DFRobot_LCD::uploadSlot(uint8_t slot, const uint8_t charmap[8]) {
+    memcpy(_cgram[slot], charmap, 8);
+    if (_async) {
+        lcd_op_t op = {LCD_OP_CGRAM, slot, {0}};
+        memcpy(op.data, charmap, 8);
+        post(op);
+        return;
     }
-    send(data, 9);
+    sendAt(LCD_SETCGRAMADDR | (slot << 3), charmap, 8);
 }
 
+// only moves the shadow write position, nothing goes out until flush()
 void DFRobot_LCD::setCursor(uint8_t col, uint8_t row) {
-    col = (row == 0 ? col | 0x80 : col | 0xc0);
-    uint8_t data[2] = {0x80, col};
-    send(data, 2);
+    _col = col < _cols ? col : _cols;
+    _row = row < _rows ? row : _rows - 1;
 }
 
 void DFRobot_LCD::setRGB(uint8_t r, uint8_t g, uint8_t b) {
-    setReg(REG_RED, r);
-    setReg(REG_GREEN, g);
-    setReg(REG_BLUE, b);
+    if (_async) {
+        // only the latest color matters, keep at most one set in flight
+        lock();
+        _pendingRGB[0] = r;
+        _pendingRGB[1] = g;
+        _pendingRGB[2] = b;
+        bool queued = _rgbPending;
+        _rgbPending = true;
+        unlock();
+
+        if (queued) return;
+        if (_refreshTimer) {
+            _rgbDeferred = true;    // goes out with the next frame
+            return;
+        }
+        lcd_op_t op = {LCD_OP_RGB, 0, {0}};
+        if (!post(op)) _rgbPending = false;
+        return;
+    }
+    writeRGB(r, g, b);
 }
 
 void DFRobot_LCD::setColor(uint8_t color) {
@@ -187,28 +399,111 @@ void DFRobot_LCD::noBlinkLED(void) {
     setReg(0x06, 0xff);
 }
 
-inline size_t DFRobot_LCD::write(uint8_t value) {
-    uint8_t data[3] = {0x40, value};
-    send(data, 2);
-    return 1;  // assume success
+// raw data byte at the controller's current address, bypasses the shadow buffer
+size_t DFRobot_LCD::write(uint8_t value) {
+    return write(&value, 1);
 }
 
-inline void DFRobot_LCD::command(uint8_t value) {
+size_t DFRobot_LCD::write(const uint8_t *buffer, size_t size) {
+    if (!_async) {
+        sendData(buffer, size);
+        return size;
+    }
+
+    size_t posted = 0;
+    while (posted < size) {
+        lcd_op_t op = {LCD_OP_DATA, 0, {0}};
+        op.arg = size - posted > sizeof(op.data) ? sizeof(op.data) : size - posted;
+        memcpy(op.data, &buffer[posted], op.arg);
+        if (!post(op)) break;
+        posted += op.arg;
+    }
+    return posted;
+}
+
+// data bytes at the controller's current address in as few transactions as
+// possible: one control byte followed by up to LCD_MAX_COLS data bytes each
+void DFRobot_LCD::sendData(const uint8_t *buffer, size_t size) {
+    uint8_t data[LCD_MAX_COLS + 1];
+    size_t sent = 0;
+
+    data[0] = 0x40;
+    while (sent < size) {
+        size_t n = size - sent > LCD_MAX_COLS ? LCD_MAX_COLS : size - sent;
+        memcpy(&data[1], &buffer[sent], n);
+        send(data, n + 1);
+        sent += n;
+    }
+}
+
+// an instruction (address set) and the data for it in one transaction:
+// Co=1 on the first control byte, so a retry always lands at the same place
+esp_err_t DFRobot_LCD::sendAt(uint8_t value, const uint8_t *buffer, size_t size) {
+    uint8_t data[LCD_MAX_COLS + 3] = {0x80, value, 0x40};
+
+    if (size > LCD_MAX_COLS) size = LCD_MAX_COLS;
+    memcpy(&data[3], buffer, size);
+    esp_err_t err = send(data, size + 3);
+    _readyAt = esp_timer_get_time() + LCD_EXEC_CMD_US;
+    return err;
+}
+
+void DFRobot_LCD::command(uint8_t value) {
+    if (_async) {
+        lcd_op_t op = {LCD_OP_COMMAND, value, {0}};
+        post(op);
+        return;
+    }
+    runCommand(value);
+}
+
+void DFRobot_LCD::runCommand(uint8_t value) {
     uint8_t data[2] = {0x80, value};
     send(data, 2);
+
+    // the wait is only paid if the next transfer comes in earlier than this
+    if (value == LCD_CLEARDISPLAY || value == LCD_RETURNHOME) {
+        _readyAt = esp_timer_get_time() + LCD_EXEC_CLEAR_US;
+    } else {
+        _readyAt = esp_timer_get_time() + LCD_EXEC_CMD_US;
+    }
+
+    if (value == LCD_CLEARDISPLAY) {
+        // the panel is blank now, keep the mirror in step with it; glyph()
+        // reads it from the producer side
+        lock();
+        memset(_panel, ' ', sizeof(_panel));
+        unlock();
+    }
+}
+
+// hold off until the controller has finished the last instruction; whole
+// ticks are slept, the remainder is a microsecond busy-wait
+void DFRobot_LCD::waitReady() {
+    const int64_t tick_us = portTICK_PERIOD_MS * 1000;
+    int64_t wait = _readyAt - esp_timer_get_time();
+
+    if (wait >= tick_us) {
+        vTaskDelay(wait / tick_us);
+        wait = _readyAt - esp_timer_get_time();
+    }
+    if (wait > 0) {
+        esp_rom_delay_us(wait);
+    }
 }
 
 void DFRobot_LCD::begin(uint8_t cols, uint8_t lines, uint8_t dotsize) {
     if (lines > 1) {
         _showfunction |= LCD_2LINE;
     }
-    vTaskDelay(50 / portTICK_PERIOD_MS);
+    _readyAt = esp_timer_get_time() + LCD_POWERUP_US;
 
     command(LCD_FUNCTIONSET | _showfunction);
-    vTaskDelay(5 / portTICK_PERIOD_MS);
+    _readyAt = esp_timer_get_time() + LCD_EXEC_INIT_US;
     command(LCD_FUNCTIONSET | _showfunction);
-    vTaskDelay(5 / portTICK_PERIOD_MS);
 
+    // set explicitly, a stack or heap instance does not start zeroed
+    _showcontrol = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
     display();
     clear();
     _showmode = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
@@ -217,29 +512,596 @@ void DFRobot_LCD::begin(uint8_t cols, uint8_t lines, uint8_t dotsize) {
     setColor(WHITE);
 }
 
-void DFRobot_LCD::send(uint8_t *data, uint8_t len) {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (_lcdAddr << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write(cmd, data, len, true);
-    i2c_master_stop(cmd);
-    i2c_master_cmd_begin(I2C_MASTER_PORT, cmd, pdMS_TO_TICKS(1000));
-    i2c_cmd_link_delete(cmd);
+esp_err_t DFRobot_LCD::send(const uint8_t *data, size_t len) {
+    waitReady();
+    return transmit(&_lcdDev, data, len);
+}
+
+// one transaction with up to LCD_I2C_RETRIES retries, counted in _stats
+esp_err_t DFRobot_LCD::transmit(i2c_bus_dev_t *dev, const uint8_t *data, size_t len) {
+    if (dev->handle == NULL) return ESP_ERR_INVALID_STATE;
+
+    const int64_t start = esp_timer_get_time();
+    esp_err_t err;
+    for (uint8_t attempt = 0; ; attempt++) {
+        err = i2c_bus_transmit(dev, data, len);
+        _stats.transactions++;
+        _stats.bytes += len + 1;
+        if (err == ESP_OK) break;
+
+        if (err == ESP_ERR_TIMEOUT) {
+            _stats.timeouts++;
+        } else {
+            _stats.nacks++;
+        }
+        if (attempt == LCD_I2C_RETRIES) break;
+        _stats.retries++;
+    }
+
+    uint32_t latency = esp_timer_get_time() - start;
+    if (latency > _stats.max_latency_us) _stats.max_latency_us = latency;
+    if (err != ESP_OK) {
+        _stats.failures++;
+        _resyncPending = true;
+    }
+    return err;
 }
 
 void DFRobot_LCD::setReg(uint8_t addr, uint8_t data) {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (_RGBAddr << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(cmd, addr, true);
-    i2c_master_write_byte(cmd, data, true);
-    i2c_master_stop(cmd);
-    i2c_master_cmd_begin(I2C_MASTER_PORT, cmd, pdMS_TO_TICKS(1000));
-    i2c_cmd_link_delete(cmd);
+    if (_async) {
+        lcd_op_t op = {LCD_OP_REG, addr, {data}};
+        post(op);
+        return;
+    }
+    writeReg(addr, data);
 }
 
+// skipped when the register already holds the value
+void DFRobot_LCD::writeReg(uint8_t addr, uint8_t data) {
+    if (_rgbDev.handle == NULL) return;
+    uint8_t reg = addr & (REG_COUNT - 1);
+    if ((_rgbValid & (1 << reg)) && _rgbRegs[reg] == data) return;
+
+    uint8_t buf[2] = {addr, data};
+    if (transmit(&_rgbDev, buf, 2) == ESP_OK) {
+        _rgbRegs[reg] = data;
+        _rgbValid |= 1 << reg;
+    }
+}
+
+// REG_RED..REG_BLUE in one auto-increment burst, nothing if the color is
+// already showing
+void DFRobot_LCD::writeRGB(uint8_t r, uint8_t g, uint8_t b) {
+    if (_rgbDev.handle == NULL) return;
+    const uint16_t mask = (1 << REG_RED) | (1 << REG_GREEN) | (1 << REG_BLUE);
+    if ((_rgbValid & mask) == mask && _rgbRegs[REG_RED] == r &&
+        _rgbRegs[REG_GREEN] == g && _rgbRegs[REG_BLUE] == b) {
+        return;
+    }
+
+    uint8_t buf[4] = {REG_RED | REG_AUTOINC, r, g, b};
+    if (transmit(&_rgbDev, buf, 4) == ESP_OK) {
+        _rgbRegs[REG_RED] = r;
+        _rgbRegs[REG_GREEN] = g;
+        _rgbRegs[REG_BLUE] = b;
+        _rgbValid |= mask;
+    }
+}
+
+// writes into the shadow buffer; text past the last column is cut off,
+// marquee() takes longer strings
 void DFRobot_LCD::printstr(const char c[]) {
-    for (int i = 0; c[i] != '\0'; i++) {
-        write(c[i]);
+    lock();
+    for (int i = 0; c[i] != '\0' && _col < _cols; i++) {
+        _shadow[_row][_col++] = c[i];
+    }
+    unlock();
+}
+
+// load text into the whole 40-cell DDRAM line behind a row, padded with
+// blanks; the next flush() uploads it once and marqueeStep() then animates
+// it with the controller's display shift, one 2-byte command per step
+// instead of rewriting the visible cells. The shift moves every row, so
+// other rows scroll along. Needs a panel of at most two rows, on four-row
+// panels each DDRAM line also holds row 2 or 3
+bool DFRobot_LCD::marquee(uint8_t row, const char *text) {
+    if (row >= _rows || _rows > 2) return false;
+
+    lock();
+    memset(_shadow[row], ' ', LCD_MAX_COLS);
+    for (int i = 0; text[i] != '\0' && i < LCD_MAX_COLS; i++) {
+        _shadow[row][i] = text[i];
+    }
+    _lineCols[row] = LCD_MAX_COLS;
+    unlock();
+    return true;
+}
+
+// the controller wraps the shift at 40 cells, the text comes round again
+void DFRobot_LCD::marqueeStep() {
+    scrollDisplayLeft();
+}
+
+// back to plain rows: undo the shift and stop tracking the hidden cells
+void DFRobot_LCD::marqueeStop() {
+    lock();
+    memset(_lineCols, _cols, sizeof(_lineCols));
+    unlock();
+
+    if (_shift != 0) {
+        // return home also resets the shift; the shadow cursor is ours and stays
+        command(LCD_RETURNHOME);
+        _shift = 0;
+    }
+}
+
+void DFRobot_LCD::flush() {
+    if (!_async) {
+        flushNow();
+        return;
+    }
+
+    if (_refreshTimer) {
+        // the next frame picks up the latest shadow, an earlier request
+        // that has not gone out yet is simply folded into it
+        if (_frameRequested) _droppedUpdates++;
+        _frameRequested = true;
+        return;
+    }
+    postFlush();
+}
+
+void DFRobot_LCD::postFlush() {
+    // one pending flush is enough, it picks up the latest shadow contents
+    if (_flushPending) return;
+    _flushPending = true;
+    lcd_op_t op = {LCD_OP_FLUSH, 0, {0}};
+    if (!post(op)) _flushPending = false;
+}
+
+// send every run of cells that changed since the last flush, one DDRAM
+// address set per run instead of rewriting whole rows
+void DFRobot_LCD::flushNow() {
+    const uint8_t entry = LCD_ENTRYLEFT | LCD_ENTRYSHIFTDECREMENT;
+    const uint8_t mode = _showmode;
+    uint8_t frame[LCD_MAX_ROWS][LCD_MAX_COLS];
+    uint8_t lineCols[LCD_MAX_ROWS];
+    bool dirty = false;
+
+    if (_resyncPending) resyncNow();
+
+    // work from a snapshot so producers can keep printing meanwhile
+    lock();
+    memcpy(frame, _shadow, sizeof(frame));
+    memcpy(lineCols, _lineCols, sizeof(lineCols));
+    unlock();
+
+    for (uint8_t row = 0; row < _rows; row++) {
+        const uint8_t cols = lineCols[row];
+        uint8_t col = 0;
+        while (col < cols) {
+            if (frame[row][col] == _panel[row][col]) {
+                col++;
+                continue;
+            }
+
+            // runs rely on the address counter stepping right without shifting
+            if (!dirty && mode != entry) {
+                runCommand(LCD_ENTRYMODESET | entry);
+            }
+            dirty = true;
+
+            // extend the run over short clean gaps, end is one past the last dirty cell
+            uint8_t start = col, end = col;
+            while (col < cols) {
+                if (frame[row][col] != _panel[row][col]) {
+                    end = ++col;
+                } else if (col - end < LCD_FLUSH_MAX_GAP) {
+                    col++;
+                } else {
+                    break;
+                }
+            }
+
+            if (sendAt(LCD_SETDDRAMADDR | (_rowOffset[row] + start), &frame[row][start], end - start) == ESP_OK) {
+                lock();
+                memcpy(&_panel[row][start], &frame[row][start], end - start);
+                unlock();
+            }
+            col = end;
+        }
+    }
+
+    if (dirty && mode != entry) {
+        runCommand(LCD_ENTRYMODESET | mode);
+    }
+}
+
+// the controllers may have lost anything since the failure: configuration,
+// CGRAM and backlight go back from our copies, the screen is cleared so the
+// flush that follows redraws every cell
+void DFRobot_LCD::resyncNow() {
+    _resyncPending = false;
+    _stats.resyncs++;
+
+    // same sequence as begin(), in case the controller was power cycled
+    runCommand(LCD_FUNCTIONSET | _showfunction);
+    _readyAt = esp_timer_get_time() + LCD_EXEC_INIT_US;
+    runCommand(LCD_FUNCTIONSET | _showfunction);
+    runCommand(LCD_DISPLAYCONTROL | _showcontrol);
+    runCommand(LCD_CLEARDISPLAY);
+    runCommand(LCD_ENTRYMODESET | _showmode);
+    for (uint8_t slot = 0; slot < LCD_CGRAM_SLOTS; slot++) {
+        sendAt(LCD_SETCGRAMADDR | (slot << 3), _cgram[slot], 8);
+    }
+    for (uint8_t i = 0; i < _shift; i++) {
+        runCommand(LCD_CURSORSHIFT | LCD_DISPLAYMOVE | LCD_MOVELEFT);
+    }
+
+    uint16_t valid = _rgbValid;
+    _rgbValid = 0;
+    for (uint8_t reg = 0; reg < REG_COUNT; reg++) {
+        if (valid & (1 << reg)) writeReg(reg, _rgbRegs[reg]);
+    }
+}
+
+// CGRAM slots a bargraph set occupies from slot 0, kept from the glyph manager
+static uint8_t graph_slots(uint8_t graphtype) {
+    switch (graphtype) {
+    case LCD_VERTICAL_BAR_GRAPH: return 7;
+    case LCD_HORIZONTAL_BAR_GRAPH: return 4;
+    case LCD_HORIZONTAL_LINE_GRAPH: return 5;
+    default: return 0;
+    }
+}
+
+// load the glyphs for a bargraph type into CGRAM, only when a different
+// set is loaded. Registered glyphs in the slots the set needs are evicted,
+// and the ones on screen move to a free slot first; returns 0 on success,
+// 1 for an unknown type or when an on-screen glyph has nowhere to go
+uint8_t DFRobot_LCD::init_bargraph(uint8_t graphtype) {
+    uint8_t charmap[8];
+
+    if (graphtype == _graphtype) return 0;
+    const uint8_t needed = graph_slots(graphtype);
+    if (needed == 0) return 1;
+
+    bool visible[LCD_CGRAM_SLOTS];
+    visibleSlots(visible);
+    for (uint8_t slot = 0; slot < needed; slot++) {
+        if (_slotGlyph[slot] < 0) continue;
+        if (visible[slot] && !moveGlyph(slot, needed, visible)) return 1;
+        _slotGlyph[slot] = -1;
+    }
+
+    switch (graphtype) {
+    case LCD_HORIZONTAL_BAR_GRAPH:
+        // slot k: k + 1 pixel columns lit from the left, 0xff is the full block
+        for (uint8_t k = 0; k < 4; k++) {
+            memset(charmap, (0x1f << (4 - k)) & 0x1f, 8);
+            uploadSlot(k, charmap);
+        }
+        break;
+    case LCD_HORIZONTAL_LINE_GRAPH:
+        // slot k: only pixel column k lit
+        for (uint8_t k = 0; k < 5; k++) {
+            memset(charmap, 0x10 >> k, 8);
+            uploadSlot(k, charmap);
+        }
+        break;
+    case LCD_VERTICAL_BAR_GRAPH:
+        // slot k: k + 1 pixel rows lit from the bottom
+        for (uint8_t k = 0; k < 7; k++) {
+            memset(charmap, 0, 8);
+            memset(&charmap[7 - k], 0x1f, k + 1);
+            uploadSlot(k, charmap);
+        }
+        break;
+    }
+
+    _graphtype = graphtype;
+    return 0;
+}
+
+// move the glyph in slot from to the least recently used slot at or above
+// reserved that is not on screen, and point the cells showing it there; the
+// panel follows with the next flush
+bool DFRobot_LCD::moveGlyph(uint8_t from, uint8_t reserved, bool visible[LCD_CGRAM_SLOTS]) {
+    int to = -1;
+    for (uint8_t slot = reserved; slot < LCD_CGRAM_SLOTS; slot++) {
+        if (!visible[slot] && (to < 0 || _slotUsed[slot] < _slotUsed[to])) to = slot;
+    }
+    if (to < 0) return false;
+
+    const int8_t g = _slotGlyph[from];
+    uploadSlot(to, _glyphs[g].charmap);
+    _slotGlyph[to] = g;
+    _slotUsed[to] = _slotUsed[from];
+    _slotGlyph[from] = -1;
+    visible[to] = true;
+
+    lock();
+    for (uint8_t row = 0; row < _rows; row++) {
+        for (uint8_t col = 0; col < _lineCols[row]; col++) {
+            if (_shadow[row][col] == from) _shadow[row][col] = to;
+        }
+    }
+    unlock();
+    return true;
+}
+
+// CGRAM slots some cell refers to, on the glass (_panel, until the next
+// flush lands) or in the shadow buffer
+void DFRobot_LCD::visibleSlots(bool visible[LCD_CGRAM_SLOTS]) {
+    memset(visible, 0, LCD_CGRAM_SLOTS * sizeof(bool));
+    lock();
+    for (uint8_t row = 0; row < _rows; row++) {
+        for (uint8_t col = 0; col < _lineCols[row]; col++) {
+            if (_shadow[row][col] < LCD_CGRAM_SLOTS) visible[_shadow[row][col]] = true;
+            if (_panel[row][col] < LCD_CGRAM_SLOTS) visible[_panel[row][col]] = true;
+        }
+    }
+    unlock();
+}
+
+// len cells from (column, row) rightwards. For a bar graph pixel_col_end is
+// the fill level, 0..len * 5 pixel columns; for a line graph it is the pixel
+// column of the marker. Like printstr this only updates the shadow buffer.
+void DFRobot_LCD::draw_horizontal_graph(uint8_t row, uint8_t column, uint8_t len, uint8_t pixel_col_end) {
+    if (_graphtype != LCD_HORIZONTAL_BAR_GRAPH && _graphtype != LCD_HORIZONTAL_LINE_GRAPH &&
+        init_bargraph(LCD_HORIZONTAL_BAR_GRAPH) != 0) {
+        return;
+    }
+    if (row >= _rows) return;
+
+    lock();
+    for (uint8_t i = 0; i < len && column + i < _cols; i++) {
+        int lit = pixel_col_end - i * 5;  // pixels that fall into this cell
+        uint8_t cell = ' ';
+        if (_graphtype == LCD_HORIZONTAL_BAR_GRAPH) {
+            if (lit >= 5) {
+                cell = 0xff;
+            } else if (lit > 0) {
+                cell = lit - 1;
+            }
+        } else if (lit >= 0 && lit < 5) {
+            cell = lit;
+        }
+        _shadow[row][column + i] = cell;
+    }
+    unlock();
+}
+
+// len cells from (column, row) upwards, filled to pixel_row_end pixel rows
+// (0..len * 8)
+void DFRobot_LCD::draw_vertical_graph(uint8_t row, uint8_t column, uint8_t len, uint8_t pixel_row_end) {
+    if (_graphtype != LCD_VERTICAL_BAR_GRAPH && init_bargraph(LCD_VERTICAL_BAR_GRAPH) != 0) {
+        return;
+    }
+    if (column >= _cols || row >= _rows) return;
+
+    lock();
+    for (uint8_t i = 0; i < len && i <= row; i++) {
+        int lit = pixel_row_end - i * 8;
+        uint8_t cell = ' ';
+        if (lit >= 8) {
+            cell = 0xff;
+        } else if (lit > 0) {
+            cell = lit - 1;
+        }
+        _shadow[row - i][column] = cell;
+    }
+    unlock();
+}
+
+// add a glyph to the manager, or replace the bitmap of a known id; false
+// when the table is full
+bool DFRobot_LCD::registerGlyph(uint8_t id, const uint8_t charmap[8]) {
+    uint8_t g = 0;
+    while (g < _glyphCount && _glyphs[g].id != id) {
+        g++;
+    }
+    if (g == LCD_MAX_GLYPHS) return false;
+    if (g == _glyphCount) _glyphCount++;
+
+    _glyphs[g].id = id;
+    memcpy(_glyphs[g].charmap, charmap, 8);
+
+    // a slot still holding the old bitmap has to be reloaded on next use
+    for (uint8_t slot = 0; slot < LCD_CGRAM_SLOTS; slot++) {
+        if (_slotGlyph[slot] == g) _slotGlyph[slot] = -1;
+    }
+    return true;
+}
+
+// character code for a registered glyph, uploading it on a miss into the
+// least recently used slot that is neither on screen nor holding the loaded
+// bargraph set; -1 for an unknown id or when no slot is free
+int DFRobot_LCD::glyph(uint8_t id) {
+    uint8_t g = 0;
+    while (g < _glyphCount && _glyphs[g].id != id) {
+        g++;
+    }
+    if (g == _glyphCount) return -1;
+
+    _glyphClock++;
+    for (uint8_t slot = 0; slot < LCD_CGRAM_SLOTS; slot++) {
+        if (_slotGlyph[slot] == g) {
+            _slotUsed[slot] = _glyphClock;
+            _glyphHits++;
+            return slot;
+        }
+    }
+
+    bool visible[LCD_CGRAM_SLOTS];
+    visibleSlots(visible);
+
+    int victim = -1;
+    for (uint8_t slot = graph_slots(_graphtype); slot < LCD_CGRAM_SLOTS; slot++) {
+        if (!visible[slot] && (victim < 0 || _slotUsed[slot] < _slotUsed[victim])) {
+            victim = slot;
+        }
+    }
+    if (victim < 0) return -1;
+
+    _glyphMisses++;
+    uploadSlot(victim, _glyphs[g].charmap);
+    _slotGlyph[victim] = g;
+    _slotUsed[victim] = _glyphClock;
+    return victim;
+}
+
+// a registered glyph at the shadow cursor, '?' if it cannot be mapped
+void DFRobot_LCD::printGlyph(uint8_t id) {
+    int code = glyph(id);
+    lock();
+    if (_col < _cols) {
+        _shadow[_row][_col++] = code < 0 ? '?' : code;
+    }
+    unlock();
+}
+
+uint32_t DFRobot_LCD::glyphHits() {
+    return _glyphHits;
+}
+
+uint32_t DFRobot_LCD::glyphMisses() {
+    return _glyphMisses;
+}
+
+void DFRobot_LCD::lock() {
+    if (_lock) xSemaphoreTake(_lock, portMAX_DELAY);
+}
+
+void DFRobot_LCD::unlock() {
+    if (_lock) xSemaphoreGive(_lock);
+}
+
+// flushes, colors and raw data never block the producer: a later flush or
+// color supersedes them, and write() reports what was posted. Commands,
+// CGRAM uploads and RGB registers change state the driver has already
+// recorded, so they wait up to LCD_POST_WAIT_MS for room; one that still
+// cannot be queued is counted and left to a resync on the next flush,
+// which rebuilds both controllers from the driver's copies
+bool DFRobot_LCD::post(const lcd_op_t &op) {
+    const bool state = op.type == LCD_OP_COMMAND || op.type == LCD_OP_CGRAM || op.type == LCD_OP_REG;
+    const TickType_t wait = state ? pdMS_TO_TICKS(LCD_POST_WAIT_MS) : 0;
+    if (xQueueSend(_queue, &op, wait) == pdTRUE) return true;
+
+    _droppedOps++;
+    if (!state) return false;
+
+    if (op.type == LCD_OP_REG) {
+        // the copy resyncNow() writes back from
+        uint8_t reg = op.arg & (REG_COUNT - 1);
+        _rgbRegs[reg] = op.data[0];
+        _rgbValid |= 1 << reg;
+    }
+    _resyncPending = true;
+    if (_refreshTimer) {
+        _frameRequested = true;     // the next frame posts the flush
+    } else if (!_flushPending) {
+        _flushPending = true;
+        lcd_op_t flush = {LCD_OP_FLUSH, 0, {0}};
+        if (xQueueSend(_queue, &flush, wait) != pdTRUE) _flushPending = false;
+    }
+    return false;
+}
+
+void DFRobot_LCD::execute(const lcd_op_t &op) {
+    switch (op.type) {
+    case LCD_OP_COMMAND:
+        runCommand(op.arg);
+        break;
+    case LCD_OP_DATA:
+        sendData(op.data, op.arg);
+        break;
+    case LCD_OP_CGRAM:
+        sendAt(LCD_SETCGRAMADDR | (op.arg << 3), op.data, 8);
+        break;
+    case LCD_OP_REG:
+        writeReg(op.arg, op.data[0]);
+        break;
+    case LCD_OP_RGB: {
+        uint8_t rgb[3];
+        lock();
+        memcpy(rgb, _pendingRGB, sizeof(rgb));
+        _rgbPending = false;
+        unlock();
+        writeRGB(rgb[0], rgb[1], rgb[2]);
+        break;
+    }
+    }
+}
+
+// the highest set bit of an HD44780 instruction identifies it
+static uint8_t command_kind(uint8_t value) {
+    uint8_t kind = 0x80;
+    while (kind && !(value & kind)) {
+        kind >>= 1;
+    }
+    return kind;
+}
+
+// true when a later op in the batch makes batch[i] redundant: register
+// writes, display control, entry mode and cursor moves only need their last
+// value, as long as no data in between depends on them (color sets and
+// flushes are already coalesced by the producer)
+static bool superseded(const lcd_op_t *batch, size_t i, size_t n) {
+    const lcd_op_t &op = batch[i];
+    uint8_t kind = op.type == LCD_OP_COMMAND ? command_kind(op.arg) : 0;
+
+    for (size_t j = i + 1; j < n; j++) {
+        const lcd_op_t &later = batch[j];
+        switch (op.type) {
+        case LCD_OP_REG:
+            if (later.type == LCD_OP_REG && later.arg == op.arg) return true;
+            break;
+        case LCD_OP_COMMAND:
+            if (kind != LCD_SETDDRAMADDR && kind != LCD_DISPLAYCONTROL && kind != LCD_ENTRYMODESET) {
+                return false;
+            }
+            if (kind != LCD_DISPLAYCONTROL && (later.type == LCD_OP_DATA || later.type == LCD_OP_CGRAM)) {
+                return false;
+            }
+            if (later.type == LCD_OP_COMMAND && command_kind(later.arg) == kind) return true;
+            break;
+        default:
+            return false;
+        }
+    }
+    return false;
+}
+
+void DFRobot_LCD::renderTask(void *arg) {
+    static_cast<DFRobot_LCD *>(arg)->render();
+}
+
+// drain whatever is queued, drop the redundant ops and apply at most one
+// shadow flush per batch, after everything else
+void DFRobot_LCD::render() {
+    lcd_op_t batch[LCD_QUEUE_DEPTH];
+
+    while (true) {
+        size_t n = 0;
+        xQueueReceive(_queue, &batch[n++], portMAX_DELAY);
+        while (n < LCD_QUEUE_DEPTH && xQueueReceive(_queue, &batch[n], 0) == pdTRUE) {
+            n++;
+        }
+
+        bool flush = false;
+        for (size_t i = 0; i < n; i++) {
+            if (batch[i].type == LCD_OP_FLUSH) {
+                flush = true;
+            } else if (!superseded(batch, i, n)) {
+                execute(batch[i]);
+            }
+        }
+
+        if (flush) {
+            _flushPending = false;
+            flushNow();
+            _framesDrawn++;
+        }
     }
 }
\ No newline at end of file
@@ -1,6 +1,6 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "driver/i2c.h"
+#include "driver/i2c_master.h"
 #include "DFRobot_LCD.h"
 
 DFRobot_LCD lcd(20, 2);
@@ -11,6 +11,7 @@ extern "C" void app_main() {
     // Create the LCD object
     printf("Initializing LCD...\n");
     lcd.init();
+    lcd.startRefresh(); // the panel sees LCD_REFRESH_FPS frames whatever the loop does
     printf("LCD Initialized\n");
 
     while (true) {
@@ -20,5 +21,10 @@ extern "C" void app_main() {
         lcd.printstr("Hello CSE121!"); // print top line
         lcd.setCursor(0, 1); // set cursor to second line
         lcd.printstr("Huang"); // print bottom line
+        lcd.flush(); // picked up by the next frame, no bus traffic once the text is on the panel
+
+        // nothing above blocks, the refresh timer does the bus work; one pass
+        // a frame leaves the CPU to IDLE and its watchdog
+        vTaskDelay(pdMS_TO_TICKS(1000 / LCD_REFRESH_FPS));
     }
 }
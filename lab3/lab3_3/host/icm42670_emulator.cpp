@@ -0,0 +1,92 @@
+/*!
+ * @file icm42670_emulator.cpp
+ * @brief Host model of the ICM-42670-P register interface
+ */
+
+#include <string.h>
+#include "icm42670_emulator.h"
+
+Icm42670Emulator &icm42670_emulator(int port) {
+    static Icm42670Emulator emulators[EMU_PORTS];
+    return emulators[port];
+}
+
+Icm42670Emulator::Icm42670Emulator(uint8_t addr) {
+    _addr = addr;
+    reset();
+}
+
+void Icm42670Emulator::reset() {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _pointer = 0;
+    memset(_regs, 0, sizeof(_regs));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+uint8_t Icm42670Emulator::address() const {
+    return _addr;
+}
+
+uint8_t Icm42670Emulator::dataByte(uint32_t sample, uint8_t reg) {
+    return (uint8_t)(sample + reg);
+}
+
+// every byte is 9 SCL periods with its ACK, plus the START/STOP conditions
+void Icm42670Emulator::account(int64_t scl_periods, size_t bytes, uint32_t scl_hz) {
+    int64_t duration = (int64_t)(scl_periods * 1e6 / scl_hz + 0.5);
+    _stats.transactions++;
+    _stats.bytes += bytes;
+    _stats.bus_us += duration;
+    emu_advance(duration);
+}
+
+void Icm42670Emulator::read(uint8_t *data, size_t len) {
+    const uint32_t sample = emu_now() / EMU_ICM_ODR_US;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t reg = _pointer++ % EMU_ICM_REGS;
+        bool output = reg >= EMU_ICM_DATA_FIRST && reg <= EMU_ICM_DATA_LAST;
+        data[i] = output ? dataByte(sample, reg) : _regs[reg];
+    }
+}
+
+esp_err_t Icm42670Emulator::transmit(const uint8_t *data, size_t len, uint32_t scl_hz) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    if (len > 0) _pointer = data[0];
+    for (size_t i = 1; i < len; i++) {
+        _regs[_pointer++ % EMU_ICM_REGS] = data[i];
+    }
+    account(2 + 9 * (len + 1), len + 1, scl_hz);
+    return ESP_OK;
+}
+
+esp_err_t Icm42670Emulator::receive(uint8_t *data, size_t len, uint32_t scl_hz) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    read(data, len);
+    account(2 + 9 * (len + 1), len + 1, scl_hz);
+    return ESP_OK;
+}
+
+// START, address, register, repeated START, address, data, STOP
+esp_err_t Icm42670Emulator::transmitReceive(const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len,
+                                            uint32_t scl_hz) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    if (tx_len > 0) _pointer = tx[0];
+    read(rx, rx_len);
+    account(3 + 9 * (tx_len + 1) + 9 * (rx_len + 1), tx_len + rx_len + 2, scl_hz);
+    return ESP_OK;
+}
+
+uint8_t Icm42670Emulator::reg(uint8_t reg) const {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _regs[reg % EMU_ICM_REGS];
+}
+
+emu_stats_t Icm42670Emulator::stats() const {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _stats;
+}
+
+void Icm42670Emulator::resetStats() {
+    std::lock_guard<std::mutex> guard(_mutex);
+    memset(&_stats, 0, sizeof(_stats));
+}
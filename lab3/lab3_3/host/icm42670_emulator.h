@@ -0,0 +1,59 @@
+/*!
+ * @file icm42670_emulator.h
+ * @brief Host model of the ICM-42670-P register interface: register writes,
+ *        auto-incrementing burst reads and output registers that move on to
+ *        a new sample every output data period
+ */
+
+#ifndef __ICM42670_EMULATOR_H__
+#define __ICM42670_EMULATOR_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include "esp_err.h"
+#include "lcd_emulator.h"
+
+// 100 Hz, the rate the labs configure
+#define EMU_ICM_ODR_US 10000
+#define EMU_ICM_DATA_FIRST 0x09     // TEMP_DATA1
+#define EMU_ICM_DATA_LAST 0x16      // GYRO_DATA_Z0
+#define EMU_ICM_REGS 0x80
+
+class Icm42670Emulator {
+public:
+    Icm42670Emulator(uint8_t addr = 0x68);
+
+    void reset();
+    uint8_t address() const;
+
+    // one transaction as seen on the bus, called by the i2c_master stubs; the
+    // first byte written sets the register pointer
+    esp_err_t transmit(const uint8_t *data, size_t len, uint32_t scl_hz);
+    esp_err_t receive(uint8_t *data, size_t len, uint32_t scl_hz);
+    esp_err_t transmitReceive(const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len, uint32_t scl_hz);
+
+    // output register reg of sample n: (n + reg) & 0xFF, so the bytes of a
+    // read tell whether they all came from one sample
+    static uint8_t dataByte(uint32_t sample, uint8_t reg);
+
+    uint8_t reg(uint8_t reg) const;
+    emu_stats_t stats() const;
+    void resetStats();
+
+private:
+    // the output registers hold still for the length of a burst
+    void read(uint8_t *data, size_t len);
+    void account(int64_t scl_periods, size_t bytes, uint32_t scl_hz);
+
+    mutable std::mutex _mutex;
+    uint8_t _addr;
+    uint8_t _pointer;
+    uint8_t _regs[EMU_ICM_REGS];
+    emu_stats_t _stats;
+};
+
+// the sensor on each I2C port
+Icm42670Emulator &icm42670_emulator(int port = 0);
+
+#endif // __ICM42670_EMULATOR_H__
@@ -0,0 +1,341 @@
+/*!
+ * @file lcd_bench.cpp
+ * @brief Runs DFRobot_LCD operations against the emulator, prints the bus
+ *        cost of each one and checks the resulting screen contents
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "DFRobot_LCD.h"
+#include "LCD_Widgets.h"
+#include "host_stubs.h"
+#include "lcd_emulator.h"
+
+static int failures = 0;
+static uint32_t violations = 0;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("  FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static void expect_row(uint8_t row, const char *text, int port = 0) {
+    std::string want(text);
+    std::string got = lcd_emulator(port).row(row);
+    want.resize(got.size(), ' ');
+    if (got != want) {
+        printf("  FAIL: row %u is \"%s\", expected \"%s\"\n", row, got.c_str(), want.c_str());
+        failures++;
+    }
+}
+
+// print the traffic since the last report and start counting afresh
+static void report(const char *name, int port = 0) {
+    emu_stats_t s = lcd_emulator(port).stats();
+    printf("%-32s %6u %6u %9lld\n", name, s.transactions, s.bytes, (long long)s.bus_us);
+    violations += s.busy_violations;
+    lcd_emulator(port).resetStats();
+}
+
+static void expect_fixed(int32_t value, uint8_t decimals, const char *text) {
+    char buf[16];
+    lcd_format_fixed(buf, sizeof(buf), value, decimals);
+    if (strcmp(buf, text) != 0) {
+        printf("  FAIL: lcd_format_fixed(%d, %u) is \"%s\", expected \"%s\"\n",
+               (int)value, decimals, buf, text);
+        failures++;
+    }
+}
+
+static void frame(DFRobot_LCD &lcd, const char *top, const char *bottom) {
+    lcd.setColor(BONNIE_BLUE);
+    lcd.setCursor(0, 0);
+    lcd.printstr(top);
+    lcd.setCursor(0, 1);
+    lcd.printstr(bottom);
+    lcd.flush();
+}
+
+int main() {
+    DFRobot_LCD lcd(20, 2);
+    uint8_t heart[8] = {0x00, 0x0a, 0x1f, 0x1f, 0x0e, 0x04, 0x00, 0x00};
+
+    lcd_emulator().reset(20, 2);
+    printf("%-32s %6s %6s %9s\n", "operation", "xfers", "bytes", "bus_us");
+
+    lcd.init();
+    report("init");
+    check(lcd_emulator().displayOn(), "display on after init");
+    check(lcd_emulator().reg(REG_RED) == 255 && lcd_emulator().reg(REG_BLUE) == 255, "white backlight after init");
+    expect_row(0, "");
+    expect_row(1, "");
+
+    frame(lcd, "Temp: 23C", "Hum : 40%");
+    report("lab3_3 frame, first");
+    expect_row(0, "Temp: 23C");
+    expect_row(1, "Hum : 40%");
+    check(lcd_emulator().reg(REG_RED) == 81 && lcd_emulator().reg(REG_GREEN) == 201 &&
+          lcd_emulator().reg(REG_BLUE) == 245, "bonnie blue backlight");
+
+    frame(lcd, "Temp: 23C", "Hum : 40%");
+    report("lab3_3 frame, unchanged");
+
+    frame(lcd, "Temp: 24C", "Hum : 40%");
+    report("lab3_3 frame, one digit");
+    expect_row(0, "Temp: 24C");
+
+    lcd.setCursor(0, 0);
+    lcd.printstr("ABCDEFGHIJKLMNOPQRST");
+    lcd.flush();
+    report("full 20-col row");
+    expect_row(0, "ABCDEFGHIJKLMNOPQRST");
+
+    lcd.clear();
+    lcd.printstr("after clear");
+    lcd.flush();
+    report("clear + short write");
+    expect_row(0, "after clear");
+    expect_row(1, "");
+
+    expect_fixed(0, 0, "0");
+    expect_fixed(23, 0, "23");
+    expect_fixed(-5, 0, "-5");
+    expect_fixed(2315, 2, "23.15");
+    expect_fixed(5, 2, "0.05");
+    expect_fixed(-105, 1, "-10.5");
+    expect_fixed(INT32_MIN, 0, "-2147483648");
+    expect_fixed(5, 12, "0.0000000005");
+
+    LCDField temp(lcd, 0, 0, "Temp: ", 3, 0, "C");
+    LCDField hum(lcd, 0, 1, "Hum : ", 5, 1, "%");
+    lcd.clear();
+    temp.set(23);
+    hum.set(405);
+    lcd.flush();
+    report("fields, first");
+    expect_row(0, "Temp:  23C");
+    expect_row(1, "Hum :  40.5%");
+
+    temp.set(23);
+    hum.set(412);
+    lcd.flush();
+    report("fields, one changed");
+    expect_row(1, "Hum :  41.2%");
+
+    temp.set(-4);
+    lcd.flush();
+    report("fields, shorter value");
+    expect_row(0, "Temp:  -4C");
+
+    temp.set(12345);
+    lcd.flush();
+    expect_row(0, "Temp: ###C");
+    temp.set(7);
+    lcd.flush();
+    report("fields, value wider than width");
+    expect_row(0, "Temp:   7C");
+
+    lcd.customSymbol(0, heart);
+    report("customSymbol");
+    check(memcmp(lcd_emulator().cgram(0), heart, 8) == 0, "CGRAM slot 0 holds the glyph");
+
+    lcd.clear();
+    lcd.draw_horizontal_graph(1, 0, 10, 23);
+    lcd.flush();
+    report("bargraph, first draw");
+    expect_row(1, "\xff\xff\xff\xff\x02");
+
+    lcd.draw_horizontal_graph(1, 0, 10, 24);
+    lcd.flush();
+    report("bargraph, +1 pixel");
+    expect_row(1, "\xff\xff\xff\xff\x03");
+
+    lcd.registerGlyph(1, heart);
+    lcd.setCursor(19, 0);
+    lcd.printGlyph(1);
+    lcd.flush();
+    report("glyph, cold");
+
+    lcd.setCursor(19, 0);
+    lcd.printGlyph(1);
+    lcd.flush();
+    report("glyph, warm");
+    check(lcd.glyphHits() == 1 && lcd.glyphMisses() == 1, "one glyph miss then one hit");
+
+    // the glyph upload must not make the driver forget the bar set it has loaded
+    lcd.draw_horizontal_graph(1, 0, 10, 24);
+    lcd.flush();
+    check(lcd_emulator().stats().transactions == 0, "unchanged bar after a glyph miss sends nothing");
+    report("bargraph, after a glyph miss");
+
+    // the vertical set needs slots 0..6, so the heart on screen has to move
+    lcd.draw_vertical_graph(1, 0, 2, 10);
+    lcd.flush();
+    report("bargraph over a glyph");
+    uint8_t code = lcd_emulator().ddram(19);
+    check(code == 7 && memcmp(lcd_emulator().cgram(code), heart, 8) == 0,
+          "glyph on screen moved clear of the vertical bars");
+
+    lcd.scrollDisplayLeft();
+    report("scrollDisplayLeft");
+    check(lcd_emulator().shift() == 1, "display shifted by one");
+    lcd.scrollDisplayRight();
+    lcd_emulator().resetStats();
+
+    const char *ticker = "Status: sampling every 1s, all ok";
+    lcd.clear();
+    check(lcd.marquee(0, ticker), "marquee accepted on a two-row panel");
+    lcd.flush();
+    report("marquee, load");
+    expect_row(0, "Status: sampling eve");
+    for (int i = 0; i < 10; i++) {
+        lcd.marqueeStep();
+    }
+    report("marquee, 10 steps");
+    expect_row(0, "mpling every 1s, all");
+    for (int i = 0; i < 30; i++) {
+        lcd.marqueeStep();
+    }
+    lcd_emulator().resetStats();
+    check(lcd_emulator().shift() % EMU_LINE_LENGTH == 0, "marquee wraps after 40 steps");
+    expect_row(0, "Status: sampling eve");
+    lcd.marqueeStep();
+    lcd.marqueeStop();
+    report("marqueeStop");
+    check(lcd_emulator().shift() == 0, "marqueeStop undoes the shift");
+
+    // a second display on its own bus that only works at standard mode, and
+    // a text-only panel handed a device handle with no backlight controller
+    i2c_master_bus_config_t bus_config = {};
+    bus_config.i2c_port = I2C_NUM_1;
+    i2c_master_bus_handle_t bus1 = NULL;
+    check(i2c_new_master_bus(&bus_config, &bus1) == ESP_OK, "second bus created");
+    lcd_emulator(1).reset(16, 2);
+    lcd_emulator(1).setMaxSclHz(I2C_BUS_STD_HZ);
+    DFRobot_LCD second(16, 2);
+    second.init(bus1);
+    frame(second, "second", "display");
+    check(lcd_emulator(1).stats().transactions > 0, "second display driven on port 1");
+    check(lcd_emulator(1).stats().nacks == 4, "each controller stepped down twice");
+    check(lcd_emulator(1).displayOn(), "nothing lost while stepping down");
+    report("second bus, 100 kHz only", 1);
+    check(lcd_emulator(1).row(0) == "second          ", "second display row 0");
+    check(lcd_emulator().row(0) != lcd_emulator(1).row(0), "first display untouched");
+
+    i2c_device_config_t dev_config = {};
+    dev_config.device_address = LCD_ADDRESS;
+    dev_config.scl_speed_hz = I2C_BUS_STD_HZ;
+    i2c_master_dev_handle_t text_only = NULL;
+    i2c_master_bus_add_device(bus1, &dev_config, &text_only);
+    lcd_emulator(1).reset(16, 2);
+    DFRobot_LCD plain(16, 2);
+    plain.init(text_only, NULL);
+    frame(plain, "no backlight", "");
+    expect_row(0, "no backlight", 1);
+    check(lcd_emulator(1).reg(REG_RED) == 0, "no RGB traffic without a handle");
+    report("text-only panel, init + frame", 1);
+
+    // failures on the fixed-speed panel, nothing steps down underneath
+    plain.resetStats();
+    lcd_emulator(1).failNext(1);
+    plain.setCursor(0, 1);
+    plain.printstr("retried");
+    plain.flush();
+    report("one NACK, retried", 1);
+    expect_row(1, "retried", 1);
+    check(plain.stats().retries == 1 && plain.stats().failures == 0, "one retry, no failure");
+
+    lcd_emulator(1).failNext(LCD_I2C_RETRIES + 1);
+    plain.setCursor(0, 1);
+    plain.printstr("lost   ");
+    plain.flush();
+    report("NACK on every retry", 1);
+    expect_row(1, "retried", 1);
+    check(plain.stats().failures == 1 && plain.stats().nacks == LCD_I2C_RETRIES + 2, "failure counted");
+    plain.flush();
+    report("resync on next flush", 1);
+    expect_row(0, "no backlight", 1);
+    expect_row(1, "lost", 1);
+    check(plain.stats().resyncs == 1, "one resync");
+    check(plain.stats().max_latency_us > 0, "latency measured");
+
+    // a four-row panel: rows 2 and 3 continue DDRAM lines 0x00 and 0x40
+    lcd_emulator(1).reset(20, 4);
+    DFRobot_LCD quad(20, 4);
+    quad.init(bus1);
+    for (uint8_t row = 0; row < 4; row++) {
+        char text[8];
+        snprintf(text, sizeof(text), "row %u", row);
+        quad.setCursor(row, row);
+        quad.printstr(text);
+    }
+    quad.setCursor(15, 9);
+    quad.printstr("last");
+    quad.flush();
+    report("20x4 panel, four rows", 1);
+    expect_row(0, "row 0", 1);
+    expect_row(1, " row 1", 1);
+    expect_row(2, "  row 2", 1);
+    expect_row(3, "   row 3       last", 1);
+    static_assert(lcd_row_offset(20, 2) == 0x14 && lcd_row_offset(20, 3) + 1 == 0x55,
+                  "20x4 row offsets");
+
+    // the main display loses power: everything comes back from the driver
+    lcd.clear();
+    lcd.setColor(BONNIE_BLUE);
+    lcd.customSymbol(2, heart);
+    lcd.setCursor(0, 1);
+    lcd.printstr("survives\x02");
+    lcd.flush();
+    lcd_emulator().reset(20, 2);
+    lcd.resync();
+    report("power cycle + resync");
+    check(lcd_emulator().displayOn(), "display on after resync");
+    expect_row(1, "survives\x02");
+    check(memcmp(lcd_emulator().cgram(2), heart, 8) == 0, "CGRAM restored");
+    check(lcd_emulator().reg(REG_RED) == 81 && lcd_emulator().reg(REG_BLUE) == 245, "backlight restored");
+
+    // async mode stays last, every call after startAsync() is queued
+    lcd.clear();
+    lcd.startAsync();
+    host_wait_idle();
+    lcd_emulator().resetStats();
+    for (int i = 0; i < 100; i++) {
+        frame(lcd, "Temp: 25C", "Hum : 41%");
+    }
+    host_wait_idle();
+    report("async, 100 identical frames");
+    expect_row(0, "Temp: 25C");
+    expect_row(1, "Hum : 41%");
+
+    // refresh scheduler: a loop updating 100 times a second, 10 frames a second
+    // reach the panel. Waiting for the render task after every step keeps
+    // it in step with the virtual clock
+    check(lcd.startRefresh(10), "refresh scheduler started");
+    lcd_emulator().resetStats();
+    char line[21];
+    for (int i = 0; i < 300; i++) {
+        snprintf(line, sizeof(line), "count %5d", i);
+        lcd.setColor(i % 2 ? BONNIE_BLUE : WHITE);
+        lcd.setCursor(0, 0);
+        lcd.printstr(line);
+        lcd.flush();
+        vTaskDelay(1);
+        host_wait_idle();
+    }
+    vTaskDelay(10);
+    host_wait_idle();
+    check(lcd_emulator().stats().transactions <= 2 * 31, "at most a frame and a color per period");
+    report("refresh 10 fps, 300 updates");
+    expect_row(0, "count   299");
+    check(lcd.droppedUpdates() >= 300 - 31, "updates folded into frames");
+    check(lcd.measuredFps() >= 9 && lcd.measuredFps() <= 11, "measured fps near 10");
+    lcd.stopRefresh();
+
+    check(violations == 0, "no instruction reached the controller while busy");
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
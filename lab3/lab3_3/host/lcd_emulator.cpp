@@ -0,0 +1,257 @@
+/*!
+ * @file lcd_emulator.cpp
+ * @brief Host model of the AiP31068 text controller and the RGB backlight
+ *        controller behind DFRobot_LCD
+ */
+
+#include <string.h>
+#include <atomic>
+#include "host_stubs.h"
+#include "lcd_emulator.h"
+
+// virtual clock, advanced by modeled bus time and by the delay stubs
+static std::atomic<int64_t> s_now_us(0);
+
+int64_t emu_now() {
+    return s_now_us.load();
+}
+
+void emu_advance(int64_t us) {
+    host_run_timers(s_now_us += us);
+}
+
+LcdEmulator &lcd_emulator(int port) {
+    static LcdEmulator emulators[EMU_PORTS];
+    return emulators[port];
+}
+
+LcdEmulator::LcdEmulator(uint8_t lcdAddr, uint8_t rgbAddr) {
+    _lcdAddr = lcdAddr;
+    _rgbAddr = rgbAddr;
+    _maxSclHz = 0;
+    _failNext = 0;
+    reset(16, 2);
+}
+
+void LcdEmulator::reset(uint8_t cols, uint8_t rows) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _cols = cols;
+    _rows = rows;
+    memset(_ddram, ' ', sizeof(_ddram));
+    memset(_cgram, 0, sizeof(_cgram));
+    _ac = 0;
+    _cgMode = false;
+    _increment = true;
+    _shiftOnWrite = false;
+    _displayOn = false;
+    _cursorOn = false;
+    _blinkOn = false;
+    _twoLine = false;
+    _shift = 0;
+    _busyUntil = 0;
+    memset(_regs, 0, sizeof(_regs));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+// START, address byte, payload, STOP; every byte is 9 SCL periods with ACK
+esp_err_t LcdEmulator::transmit(uint16_t addr, const uint8_t *data, size_t len, uint32_t scl_hz) {
+    std::unique_lock<std::mutex> guard(_mutex);
+    bool fail = _failNext > 0 && (addr == _lcdAddr || addr == _rgbAddr);
+    if (fail) _failNext--;
+    if (fail || (addr != _lcdAddr && addr != _rgbAddr) || (_maxSclHz && scl_hz > _maxSclHz)) {
+        guard.unlock();
+        return nack(scl_hz);
+    }
+
+    const int64_t start = emu_now();
+    const double bit_us = 1e6 / scl_hz;
+    int64_t duration = (int64_t)((2 + 9 * (len + 1)) * bit_us + 0.5);
+
+    _stats.transactions++;
+    _stats.bytes += len + 1;
+    _stats.bus_us += duration;
+
+    if (addr == _rgbAddr) {
+        writeRegs(data, len);
+    } else {
+        // control byte: Co (bit 7) = one more control byte after the next
+        // byte, RS (bit 6) = data rather than instructions
+        size_t i = 0;
+        while (i + 1 < len) {
+            uint8_t control = data[i++];
+            bool rs = control & 0x40;
+            size_t end = (control & 0x80) ? i + 1 : len;
+            for (; i < end; i++) {
+                int64_t at = start + (int64_t)((1 + 9 * (i + 2)) * bit_us);
+                if (rs) {
+                    writeData(data[i]);
+                } else {
+                    instruction(data[i], at);
+                }
+            }
+        }
+    }
+
+    emu_advance(duration);
+    return ESP_OK;
+}
+
+void LcdEmulator::setMaxSclHz(uint32_t hz) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _maxSclHz = hz;
+}
+
+void LcdEmulator::failNext(uint32_t n) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _failNext = n;
+}
+
+esp_err_t LcdEmulator::nack(uint32_t scl_hz) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    int64_t duration = (int64_t)((2 + 9) * 1e6 / scl_hz + 0.5);
+    _stats.transactions++;
+    _stats.bytes++;
+    _stats.nacks++;
+    _stats.bus_us += duration;
+    emu_advance(duration);
+    return ESP_ERR_INVALID_STATE;
+}
+
+void LcdEmulator::instruction(uint8_t value, int64_t at) {
+    if (at < _busyUntil) {
+        _stats.busy_violations++;
+    }
+    _busyUntil = at + EMU_EXEC_CMD_US;
+
+    if (value & 0x80) {             // set DDRAM address
+        _ac = value & 0x7f;
+        _cgMode = false;
+    } else if (value & 0x40) {      // set CGRAM address
+        _ac = value & 0x3f;
+        _cgMode = true;
+    } else if (value & 0x20) {      // function set
+        _twoLine = value & 0x08;
+    } else if (value & 0x10) {      // cursor or display shift
+        bool right = value & 0x04;
+        if (value & 0x08) {
+            _shift += right ? -1 : 1;
+        } else {
+            step(right);
+        }
+    } else if (value & 0x08) {      // display on/off control
+        _displayOn = value & 0x04;
+        _cursorOn = value & 0x02;
+        _blinkOn = value & 0x01;
+    } else if (value & 0x04) {      // entry mode set
+        _increment = value & 0x02;
+        _shiftOnWrite = value & 0x01;
+    } else if (value & 0x02) {      // return home
+        _ac = 0;
+        _cgMode = false;
+        _shift = 0;
+        _busyUntil = at + EMU_EXEC_CLEAR_US;
+    } else if (value & 0x01) {      // clear display
+        memset(_ddram, ' ', sizeof(_ddram));
+        _ac = 0;
+        _cgMode = false;
+        _shift = 0;
+        _increment = true;
+        _busyUntil = at + EMU_EXEC_CLEAR_US;
+    }
+}
+
+// data writes complete within one byte time on the AiP31068 I2C interface,
+// only a pending instruction can make them too early
+void LcdEmulator::writeData(uint8_t value) {
+    if (_cgMode) {
+        _cgram[_ac & 0x3f] = value & 0x1f;
+        _ac = (_ac + (_increment ? 1 : -1)) & 0x3f;
+        return;
+    }
+
+    _ddram[_ac & 0x7f] = value;
+    step(_increment);
+    if (_shiftOnWrite) {
+        _shift += _increment ? 1 : -1;
+    }
+}
+
+// DDRAM address counter: in two-line mode 0x27 continues at 0x40 and 0x67
+// wraps back to 0x00
+void LcdEmulator::step(bool increment) {
+    if (!_twoLine) {
+        _ac = (_ac + (increment ? 1 : 79)) % 80;
+        return;
+    }
+    uint8_t line = _ac & 0x40;
+    int pos = (_ac & 0x3f) + (increment ? 1 : -1);
+    if (pos >= EMU_LINE_LENGTH) {
+        _ac = line ^ 0x40;
+    } else if (pos < 0) {
+        _ac = (line ^ 0x40) + EMU_LINE_LENGTH - 1;
+    } else {
+        _ac = line + pos;
+    }
+}
+
+// the first byte is the register pointer, with REG_AUTOINC (0x80) set the
+// pointer advances after every data byte, otherwise the same register is
+// rewritten
+void LcdEmulator::writeRegs(const uint8_t *data, size_t len) {
+    if (len == 0) return;
+    uint8_t reg = data[0] & (EMU_RGB_REGS - 1);
+    bool autoinc = data[0] & 0x80;
+    for (size_t i = 1; i < len; i++) {
+        _regs[reg] = data[i];
+        if (autoinc) {
+            reg = (reg + 1) & (EMU_RGB_REGS - 1);
+        }
+    }
+}
+
+// rows 0/1 are DDRAM lines 0x00/0x40; rows 2/3 of a four-line panel are the
+// second half of those lines, starting at cols
+std::string LcdEmulator::row(uint8_t row) const {
+    std::lock_guard<std::mutex> guard(_mutex);
+    std::string text;
+    uint8_t line = (row & 1) ? 0x40 : 0x00;
+    int base = (row & 2) ? _cols : 0;
+
+    for (int col = 0; col < _cols; col++) {
+        int pos = ((base + col + _shift) % EMU_LINE_LENGTH + EMU_LINE_LENGTH) % EMU_LINE_LENGTH;
+        text += (char)_ddram[line + pos];
+    }
+    return text;
+}
+
+uint8_t LcdEmulator::ddram(uint8_t addr) const {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _ddram[addr & 0x7f];
+}
+
+const uint8_t *LcdEmulator::cgram(uint8_t location) const {
+    return &_cgram[(location & 7) * 8];
+}
+
+uint8_t LcdEmulator::reg(uint8_t addr) const {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _regs[addr & (EMU_RGB_REGS - 1)];
+}
+
+bool LcdEmulator::displayOn() const {
+    return _displayOn;
+}
+
+int LcdEmulator::shift() const {
+    return _shift;
+}
+
+emu_stats_t LcdEmulator::stats() const {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _stats;
+}
+
+void LcdEmulator::resetStats() {
+    std::lock_guard<std::mutex> guard(_mutex);
+    memset(&_stats, 0, sizeof(_stats));
+}
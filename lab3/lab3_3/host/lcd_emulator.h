@@ -0,0 +1,97 @@
+/*!
+ * @file lcd_emulator.h
+ * @brief Host model of the AiP31068 text controller and the RGB backlight
+ *        controller behind DFRobot_LCD, fed by the i2c_master stubs
+ */
+
+#ifndef __LCD_EMULATOR_H__
+#define __LCD_EMULATOR_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include "esp_err.h"
+
+#define EMU_DDRAM_SIZE 0x80
+#define EMU_CGRAM_SIZE 64
+#define EMU_LINE_LENGTH 40
+#define EMU_RGB_REGS 16
+
+// controller execution times the model enforces (fosc = 270 kHz)
+#define EMU_EXEC_CLEAR_US 1530
+#define EMU_EXEC_CMD_US 39
+
+// bus traffic since the last resetStats()
+typedef struct {
+    uint32_t transactions;
+    uint32_t bytes;             // on the wire, address bytes included
+    uint32_t nacks;
+    int64_t bus_us;             // modeled SCL time
+    uint32_t busy_violations;   // instructions that arrived while the controller was busy
+} emu_stats_t;
+
+class LcdEmulator {
+public:
+    LcdEmulator(uint8_t lcdAddr = 0x3E, uint8_t rgbAddr = 0x2D);
+
+    // power-on state; cols/rows only affect how row() maps DDRAM to the glass
+    void reset(uint8_t cols, uint8_t rows);
+
+    // one write transaction as seen on the bus, called by the i2c_master stubs
+    esp_err_t transmit(uint16_t addr, const uint8_t *data, size_t len, uint32_t scl_hz);
+    // a transaction for a device the model does not implement: address NACK
+    esp_err_t nack(uint32_t scl_hz);
+    // fault injection: NACK every transaction clocked faster than hz, 0 for no limit
+    void setMaxSclHz(uint32_t hz);
+    // fault injection: NACK the next n transactions to either controller
+    void failNext(uint32_t n);
+
+    // what a viewer would read on the glass, row by row
+    std::string row(uint8_t row) const;
+    uint8_t ddram(uint8_t addr) const;
+    const uint8_t *cgram(uint8_t location) const;
+    uint8_t reg(uint8_t addr) const;
+    bool displayOn() const;
+    int shift() const;
+
+    emu_stats_t stats() const;
+    void resetStats();
+
+private:
+    void instruction(uint8_t value, int64_t at);
+    void writeData(uint8_t value);
+    void writeRegs(const uint8_t *data, size_t len);
+    void step(bool increment);
+
+    mutable std::mutex _mutex;
+    uint8_t _lcdAddr, _rgbAddr;
+    uint8_t _cols, _rows;
+    uint32_t _maxSclHz;
+    uint32_t _failNext;
+
+    uint8_t _ddram[EMU_DDRAM_SIZE];
+    uint8_t _cgram[EMU_CGRAM_SIZE];
+    uint8_t _ac;                // address counter
+    bool _cgMode;               // AC points into CGRAM
+    bool _increment, _shiftOnWrite;
+    bool _displayOn, _cursorOn, _blinkOn;
+    bool _twoLine;
+    int _shift;                 // display shift, positive is to the left
+    int64_t _busyUntil;
+
+    uint8_t _regs[EMU_RGB_REGS];
+
+    emu_stats_t _stats;
+};
+
+#define EMU_PORTS 2
+
+// the instance on each I2C port the i2c_master stubs talk to
+LcdEmulator &lcd_emulator(int port = 0);
+
+// virtual clock behind esp_timer_get_time(), in microseconds
+int64_t emu_now();
+void emu_advance(int64_t us);
+
+#endif // __LCD_EMULATOR_H__
@@ -0,0 +1,434 @@
+/*!
+ * @file sensor_bench.cpp
+ * @brief Runs the SHTC3 driver against the sensor emulator: sampling rate
+ *        and bus cost of each acquisition mode, plus the error paths. Checks
+ *        the fixed-point SHTC3 and SR04 conversions against the float math
+ *        they replace, the sampler's snapshots against a writer that never
+ *        stops, the windowed aggregates against a direct computation, and
+ *        ICM-42670 burst reads against the byte-at-a-time reads they replace
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "aggregate.h"
+#include "freertos/semphr.h"
+#include "host_stubs.h"
+#include "icm42670.h"
+#include "icm42670_emulator.h"
+#include "sampler.h"
+#include "shtc3.h"
+#include "shtc3_emulator.h"
+#include "sr04.h"
+
+#define SAMPLES 200
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("  FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// back-to-back shtc3_read() calls, prints the rate the virtual clock saw
+static double run(shtc3_t *sensor, const char *name) {
+    shtc3_sample_t sample = {0, 0};
+    int errors = 0;
+    shtc3_emulator().resetStats();
+    shtc3_reset_stats(sensor);
+    int64_t start = emu_now();
+    for (int i = 0; i < SAMPLES; i++) {
+        if (shtc3_read(sensor, &sample) != ESP_OK) errors++;
+    }
+    int64_t elapsed = emu_now() - start;
+    emu_stats_t s = shtc3_emulator().stats();
+    double hz = SAMPLES * 1e6 / elapsed;
+    printf("%-28s %8.1f %6u %6u %9lld %6u %6u\n", name, hz, s.transactions, s.nacks,
+           (long long)s.bus_us, sensor->latency_min_us, sensor->latency_max_us);
+    check(errors == 0, "every sample read");
+    check(sample.temperature_cC == 2500, "temperature converted");
+    check(sample.humidity_cRH == 4000, "humidity converted");
+    return hz;
+}
+
+#define CADENCE_SAMPLES 50
+
+struct cadence_cost {
+    double transactions;        // per sample
+    uint32_t wakeups;
+    double awake;               // fraction of the run the sensor was awake
+};
+
+// one sample every interval_us, start to start, prints what each one cost
+static cadence_cost cadence(shtc3_t *sensor, shtc3_power_t power, int64_t interval_us, const char *name) {
+    shtc3_sample_t sample;
+    int errors = 0;
+    shtc3_set_power(sensor, power);
+    shtc3_reset_stats(sensor);
+    int64_t start = emu_now();
+    for (int i = 0; i < CADENCE_SAMPLES; i++) {
+        int64_t next = start + i * interval_us;
+        if (next > emu_now()) emu_advance(next - emu_now());
+        if (shtc3_read(sensor, &sample) != ESP_OK) errors++;
+    }
+    cadence_cost cost = {(double)sensor->transactions / CADENCE_SAMPLES, sensor->wakeups,
+                         (double)shtc3_awake_time_us(sensor) / (emu_now() - start)};
+    printf("%-10s %8lld %8.2f %8u %7.1f%%\n", name, (long long)(interval_us / 1000),
+           cost.transactions, (unsigned)cost.wakeups, 100 * cost.awake);
+    check(errors == 0, "every sample read");
+    return cost;
+}
+
+// the fixed-point conversions against the formulas the labs used, rounded
+static void check_conversions() {
+    int mismatches = 0;
+    for (uint32_t raw = 0; raw <= 0xFFFF; raw++) {
+        double temperature = -45 + (175.0 * (raw / 65535.0));
+        double humidity = 100.0 * (raw / 65535.0);
+        if (shtc3_temperature_cC(raw) != lround(temperature * 100)) mismatches++;
+        if (shtc3_humidity_cRH(raw) != lround(humidity * 100)) mismatches++;
+    }
+    check(mismatches == 0, "SHTC3 conversions exact for every raw value");
+    check(shtc3_round_centi(2349) == 23 && shtc3_round_centi(2350) == 24 &&
+          shtc3_round_centi(-449) == -4 && shtc3_round_centi(-450) == -5, "hundredths rounded to whole");
+
+    // every temperature the SHTC3 reports against every echo up to the limit;
+    // the reference is exact rational rounding, a float product would
+    // itself be off at the ties
+    mismatches = 0;
+    for (int32_t cC = -4500; cC <= 13000; cC += 7) {
+        uint64_t speed = SR04_SOUND_BASE + (int64_t)SR04_SOUND_PER_CC * cC;
+        for (uint32_t echo = 0; echo <= SR04_MAX_ECHO_US; echo++) {
+            uint64_t expected = (echo * speed + 100000000) / 200000000;
+            if (sr04_distance_mm(echo, cC) != expected) mismatches++;
+        }
+    }
+    check(mismatches == 0, "SR04 conversion exact");
+    check(sr04_distance_mm(5824, 2000) == 1000, "1 m at 20 C");
+}
+
+// a sampler read() that parks its task for good after a number of samples,
+// host tasks cannot be deleted
+struct parked_read {
+    sampler_read_t read;
+    void *ctx;
+    uint32_t left;
+    SemaphoreHandle_t never;
+};
+
+static esp_err_t read_then_park(void *ctx, void *sample) {
+    parked_read *p = (parked_read *)ctx;
+    if (p->left == 0) {
+        p->never = xSemaphoreCreateMutex();
+        xSemaphoreTake(p->never, 0);
+        xSemaphoreTake(p->never, portMAX_DELAY);
+    }
+    p->left--;
+    return p->read(p->ctx, sample);
+}
+
+// every word of a sample holds the same count, a torn copy mixes two
+static esp_err_t read_counter(void *ctx, void *sample) {
+    uint32_t *count = (uint32_t *)ctx;
+    uint32_t *words = (uint32_t *)sample;
+    ++*count;
+    for (int i = 0; i < 4; i++) words[i] = *count;
+    return ESP_OK;
+}
+
+static esp_err_t read_shtc3(void *ctx, void *sample) {
+    return shtc3_read((shtc3_t *)ctx, (shtc3_sample_t *)sample);
+}
+
+#define TORN_SAMPLES 200000
+
+// a writer running flat out against a reader in a tight loop
+static void check_seqlock() {
+    static uint32_t count = 0;
+    static parked_read park = {read_counter, &count, TORN_SAMPLES, NULL};
+    static sampler_t sampler;
+    sampler_config_t config = {"counter", read_then_park, &park, 4 * sizeof(uint32_t), 0, 0};
+    check(sampler_start(&sampler, &config) == ESP_OK, "counter sampler started");
+
+    uint32_t words[4], sequence = 0, last = 0;
+    int torn = 0, backwards = 0, reads = 0;
+    while (last < TORN_SAMPLES) {
+        if (!sampler_latest(&sampler, words, NULL, &sequence)) continue;
+        reads++;
+        if (words[1] != words[0] || words[2] != words[0] || words[3] != words[0]) torn++;
+        if (words[0] != sequence || sequence < last) backwards++;
+        last = sequence;
+    }
+    printf("seqlock: %d reads over %u samples\n", reads, (unsigned)TORN_SAMPLES);
+    check(torn == 0, "no torn snapshot");
+    check(backwards == 0, "sequence matches the sample and never goes back");
+}
+
+// the sampler keeps its own cadence, readers only copy the snapshot
+static void check_sampler(shtc3_t *sensor) {
+    const uint32_t samples = 20, period_ms = 100;
+    static parked_read park = {read_shtc3, sensor, samples, NULL};
+    static sampler_t sampler;
+    sampler_config_t config = {"shtc3", read_then_park, &park, sizeof(shtc3_sample_t), period_ms, 0};
+
+    shtc3_sample_t sample;
+    check(!sampler_latest(&sampler, &sample, NULL, NULL), "nothing before the first sample");
+    int64_t start = emu_now();
+    check(sampler_start(&sampler, &config) == ESP_OK, "SHTC3 sampler started");
+
+    int64_t timestamp = 0;
+    uint32_t sequence = 0;
+    while (!sampler_latest(&sampler, &sample, &timestamp, &sequence) || sequence < samples) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    uint32_t transactions = shtc3_emulator().stats().transactions;
+    for (int i = 0; i < 1000; i++) sampler_latest(&sampler, &sample, NULL, NULL);
+    check(shtc3_emulator().stats().transactions == transactions, "readers stay off the bus");
+
+    int64_t span = timestamp - start;
+    printf("sampler: %u samples in %lld us\n", (unsigned)sequence, (long long)span);
+    check(sample.temperature_cC == 2500 && sample.humidity_cRH == 4000, "sampled reading");
+    check(sampler.errors == 0, "no failed samples");
+    // delays count from the previous wake, the read time does not add up;
+    // the first wake is rounded down to a tick
+    int64_t expected = (int64_t)(samples - 1) * period_ms * 1000;
+    check(span > expected - portTICK_PERIOD_MS * 1000 && span < expected + SHTC3_POLL_TIMEOUT_US,
+          "sampled on the period");
+}
+
+struct timed_sample {
+    int64_t timestamp_us;
+    int32_t values[2];
+};
+
+struct agg_run {
+    std::vector<timed_sample> samples;
+    unsigned windows[AGG_MAX_LEVELS];
+    int mismatches;
+};
+
+// the window straight from the samples it covers, two passes in double
+static void check_window(void *ctx, const agg_window_t *window) {
+    agg_run *run = (agg_run *)ctx;
+    static const int64_t lengths[] = {1000000, 60000000, 3600000000LL};
+    run->windows[window->level]++;
+    for (int c = 0; c < 2; c++) {
+        std::vector<int32_t> in;
+        auto s = std::lower_bound(run->samples.begin(), run->samples.end(), window->start_us,
+                                  [](const timed_sample &a, int64_t t) { return a.timestamp_us < t; });
+        for (; s != run->samples.end() && s->timestamp_us < window->start_us + lengths[window->level]; ++s) {
+            in.push_back(s->values[c]);
+        }
+        double mean = 0, m2 = 0;
+        int32_t lo = in[0], hi = in[0];
+        for (int32_t v : in) {
+            mean += v;
+            lo = v < lo ? v : lo;
+            hi = v > hi ? v : hi;
+        }
+        mean /= in.size();
+        for (int32_t v : in) m2 += (v - mean) * (v - mean);
+        const agg_stats_t &got = window->channel[c];
+        // the merged and the direct mean can round apart at exact halves
+        if (window->count != in.size() || got.min != lo || got.max != hi ||
+            labs(got.mean - lround(mean)) > 1 ||
+            labs(got.stddev - lround(sqrt(m2 / (in.size() - 1)))) > 1) {
+            run->mismatches++;
+        }
+    }
+}
+
+// an hour and a bit at 20 Hz through 1 s, 1 min and 1 h windows
+static void check_aggregate() {
+    static agg_run run;
+    static agg_t agg;
+    agg_config_t config = {2, 3, {1000000, 60000000, 3600000000LL}, check_window, &run};
+    check(agg_init(&agg, &config) == ESP_OK, "aggregator set up");
+    config.window_us[1] = 1500000;
+    check(agg_init(&agg, &config) == ESP_ERR_INVALID_ARG, "windows must nest");
+    config.window_us[1] = 60000000;
+    agg_init(&agg, &config);
+
+    uint32_t seed = 1;
+    int32_t humidity = 4000;
+    for (int64_t t = 1234; t <= 3600000000LL + 1234; t += 50000) {
+        seed = seed * 1664525 + 1013904223;
+        humidity += (int32_t)(seed >> 28) - 8;
+        timed_sample s = {t, {2500 + (int32_t)(seed >> 22) - 512, humidity}};
+        // a stall leaves 3 s without samples
+        if (t > 120000000 && t < 123000000) continue;
+        run.samples.push_back(s);
+        agg_add(&agg, t, s.values);
+    }
+    printf("aggregate: %zu samples, %u/%u/%u windows, %zu bytes\n", run.samples.size(),
+           run.windows[0], run.windows[1], run.windows[2], sizeof(agg));
+    check(run.windows[0] == 3600 - 3, "a window a second, none for the stall");
+    check(run.windows[1] == 60 && run.windows[2] == 1, "minutes and the hour");
+    check(run.mismatches == 0, "aggregates match the direct computation");
+}
+
+#define IMU_SAMPLES 1000
+
+// whether bytes read from registers first.. all came from one sample
+static bool coherent(const uint8_t *bytes, uint8_t first, size_t len) {
+    for (size_t i = 1; i < len; i++) {
+        if ((uint8_t)(bytes[i] - (first + i)) != (uint8_t)(bytes[0] - first)) return false;
+    }
+    return true;
+}
+
+// samples at random points of the output data period; prints what a sample
+// cost on the bus and how many mixed bytes of two samples
+static int imu_run(icm42670_t *imu, const char *name, bool burst) {
+    uint32_t seed = 7;
+    int torn = 0;
+    icm42670_emulator().resetStats();
+    for (int i = 0; i < IMU_SAMPLES; i++) {
+        seed = seed * 1664525 + 1013904223;
+        emu_advance((seed >> 8) % EMU_ICM_ODR_US);
+
+        uint8_t bytes[6];
+        if (burst) {
+            icm42670_axes_t accel;
+            check(icm42670_read_accel(imu, &accel) == ESP_OK, "burst read");
+            const int16_t axes[3] = {accel.x, accel.y, accel.z};
+            for (int a = 0; a < 3; a++) {
+                bytes[2 * a] = (uint16_t)axes[a] >> 8;
+                bytes[2 * a + 1] = (uint8_t)axes[a];
+            }
+        } else {
+            // what the labs did: one write-restart-read per register
+            for (uint8_t r = 0; r < 6; r++) {
+                check(icm42670_read_regs(imu, ICM42670_ACCEL_DATA_X1 + r, &bytes[r], 1) == ESP_OK,
+                      "byte read");
+            }
+        }
+        if (!coherent(bytes, ICM42670_ACCEL_DATA_X1, sizeof(bytes))) torn++;
+    }
+    emu_stats_t s = icm42670_emulator().stats();
+    printf("%-28s %8.1f %8.1f %6d\n", name, (double)s.transactions / IMU_SAMPLES,
+           (double)s.bus_us / IMU_SAMPLES, torn);
+    return torn;
+}
+
+static void check_icm42670(i2c_master_bus_handle_t bus) {
+    icm42670_t imu;
+    check(icm42670_init(&imu, bus) == ESP_OK, "IMU added");
+    check(icm42670_write_reg(&imu, ICM42670_ACCEL_CONFIG0, 0x29) == ESP_OK &&
+          icm42670_emulator().reg(ICM42670_ACCEL_CONFIG0) == 0x29, "register written");
+
+    printf("%-28s %8s %8s %6s\n", "accel read", "xfers", "bus_us", "torn");
+    check(imu_run(&imu, "byte at a time", false) > 0, "byte-at-a-time reads mix samples");
+    int64_t bytewise_us = icm42670_emulator().stats().bus_us;
+    check(imu_run(&imu, "one burst", true) == 0, "burst reads are coherent");
+    int64_t burst_us = icm42670_emulator().stats().bus_us;
+    check(icm42670_emulator().stats().transactions == IMU_SAMPLES, "one transaction a sample");
+    check(burst_us * 2 < bytewise_us, "under half the bus time");
+
+    icm42670_sample_t sample;
+    uint8_t bytes[14];
+    check(icm42670_read(&imu, &sample) == ESP_OK, "full sample read");
+    const int16_t words[7] = {sample.temperature, sample.accel.x, sample.accel.y, sample.accel.z,
+                              sample.gyro.x, sample.gyro.y, sample.gyro.z};
+    for (int w = 0; w < 7; w++) {
+        bytes[2 * w] = (uint16_t)words[w] >> 8;
+        bytes[2 * w + 1] = (uint8_t)words[w];
+    }
+    check(coherent(bytes, ICM42670_TEMP_DATA1, sizeof(bytes)), "temperature, accel and gyro in order");
+
+    int mismatches = 0;
+    for (int32_t raw = -32768; raw <= 32767; raw++) {
+        if (icm42670_temperature_cC(raw) != (int32_t)floor(2500 + raw * 100 / 128.0 + 0.5)) mismatches++;
+    }
+    check(mismatches == 0, "ICM-42670 temperature conversion");
+}
+
+int main() {
+    check_conversions();
+    check_aggregate();
+
+    i2c_master_bus_handle_t bus;
+    shtc3_t sensor;
+
+    check(i2c_bus_init(&bus) == ESP_OK, "bus created");
+    check(shtc3_init(&sensor, bus) == ESP_OK, "sensor added");
+    check_icm42670(bus);
+    shtc3_emulator().setReading(0x6666, 0x6666);    // 25.0 C, 40.0 %
+    shtc3_set_power(&sensor, SHTC3_POWER_SLEEP);
+
+    printf("%-28s %8s %6s %6s %9s %6s %6s\n", "mode", "Hz", "xfers", "nacks", "bus_us",
+           "min_us", "max_us");
+
+    shtc3_set_mode(&sensor, SHTC3_MODE_STRETCH);
+    double stretch = run(&sensor, "normal, stretch, sleep");
+    check(sensor.polls == 0, "no polls when stretching");
+    check(sensor.latency_min_us >= 10800, "stretched reads wait for the conversion");
+
+    shtc3_set_mode(&sensor, SHTC3_MODE_POLL);
+    double poll = run(&sensor, "normal, poll, sleep");
+    check(poll > stretch, "polling ends before the worst case");
+    check(shtc3_emulator().asleep(), "asleep between samples");
+    check(sensor.latency_max_us < 12100, "polling beats the worst case wait");
+
+    shtc3_set_low_power(&sensor, true);
+    double low_power = run(&sensor, "low power, poll, sleep");
+    check(low_power > 5 * poll, "low power conversions are an order faster");
+
+    uint32_t wakeups = shtc3_emulator().wakeups();
+    check(shtc3_set_power(&sensor, SHTC3_POWER_AWAKE) == ESP_OK, "stay awake");
+    double awake = run(&sensor, "low power, poll, awake");
+    check(awake > low_power, "staying awake saves the wakeup");
+    check(awake > 500, "hundreds of samples a second");
+    check(shtc3_emulator().wakeups() == wakeups + 1, "woken once for the whole run");
+    check(!shtc3_emulator().asleep(), "left awake");
+    check(shtc3_set_power(&sensor, SHTC3_POWER_SLEEP) == ESP_OK && shtc3_emulator().asleep(),
+          "asleep once staying awake is turned off");
+
+    shtc3_set_mode(&sensor, SHTC3_MODE_STRETCH);
+    run(&sensor, "low power, stretch, sleep");
+    shtc3_set_low_power(&sensor, false);
+    shtc3_set_mode(&sensor, SHTC3_MODE_POLL);
+
+    // the adaptive policy against both fixed ones, fast and slow
+    printf("%-10s %8s %8s %8s %8s\n", "power", "every_ms", "xfers", "wakeups", "awake");
+    cadence_cost fast_sleep = cadence(&sensor, SHTC3_POWER_SLEEP, 20000, "sleep");
+    cadence(&sensor, SHTC3_POWER_AWAKE, 20000, "awake");
+    cadence_cost fast = cadence(&sensor, SHTC3_POWER_ADAPTIVE, 20000, "adaptive");
+    check(fast.wakeups <= 1 && !shtc3_emulator().asleep(), "fast sampling stays awake");
+    check(fast.transactions < fast_sleep.transactions - 1.5, "no sleep and wakeup per sample");
+
+    cadence_cost slow_sleep = cadence(&sensor, SHTC3_POWER_SLEEP, 1000000, "sleep");
+    cadence_cost slow_awake = cadence(&sensor, SHTC3_POWER_AWAKE, 1000000, "awake");
+    cadence_cost slow = cadence(&sensor, SHTC3_POWER_ADAPTIVE, 1000000, "adaptive");
+    check(slow.wakeups >= CADENCE_SAMPLES - 1, "slow sampling sleeps between samples");
+    check(slow.awake < 2 * slow_sleep.awake && slow.awake < slow_awake.awake / 10,
+          "slow sampling keeps the power savings");
+    check(shtc3_emulator().asleep(), "asleep after slow sampling");
+    shtc3_set_power(&sensor, SHTC3_POWER_SLEEP);
+
+    // a corrupted sample is dropped and measured again
+    shtc3_sample_t sample;
+    uint32_t crc_errors = sensor.crc_errors;
+    shtc3_emulator().corruptNext(1);
+    check(shtc3_read(&sensor, &sample) == ESP_OK, "read after a bad CRC");
+    check(sensor.crc_errors == crc_errors + 1, "CRC error counted");
+
+    // collecting early is refused without touching the bus
+    check(shtc3_start_measurement(&sensor) == ESP_OK, "measurement started");
+    check(shtc3_collect(&sensor, &sample) == ESP_ERR_NOT_FINISHED, "too early");
+    check(shtc3_finish(&sensor, &sample) == ESP_OK, "finished");
+    check(shtc3_collect(&sensor, &sample) == ESP_ERR_INVALID_STATE, "nothing running");
+    check(sensor.dev.step_downs == 0, "polling NACKs never stepped the bus down");
+
+    check_seqlock();
+    check_sampler(&sensor);
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+/*!
+ * @file shtc3_emulator.cpp
+ * @brief Host model of the SHTC3 temperature/humidity sensor
+ */
+
+#include <string.h>
+#include "shtc3_emulator.h"
+
+Shtc3Emulator &shtc3_emulator(int port) {
+    static Shtc3Emulator emulators[EMU_PORTS];
+    return emulators[port];
+}
+
+// CRC-8, polynomial 0x31 starting at 0xFF, bit by bit as in the datasheet
+static uint8_t crc8(uint8_t msb, uint8_t lsb) {
+    uint8_t crc = 0xFF;
+    const uint8_t bytes[2] = {msb, lsb};
+    for (uint8_t byte : bytes) {
+        crc ^= byte;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+Shtc3Emulator::Shtc3Emulator(uint8_t addr) {
+    _addr = addr;
+    _tempRaw = 0x6666;  // ~25 C
+    _humRaw = 0x6666;   // 40 %
+    reset();
+}
+
+void Shtc3Emulator::reset() {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _asleep = false;
+    _idleAt = 0;
+    _readyAt = 0;
+    _stretch = false;
+    _result = false;
+    _corruptNext = 0;
+    _wakeups = 0;
+    _conversions = 0;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+uint8_t Shtc3Emulator::address() const {
+    return _addr;
+}
+
+// START, address byte, payload, STOP; every byte is 9 SCL periods with ACK
+void Shtc3Emulator::account(size_t len, uint32_t scl_hz) {
+    int64_t duration = (int64_t)((2 + 9 * (len + 1)) * 1e6 / scl_hz + 0.5);
+    _stats.transactions++;
+    _stats.bytes += len + 1;
+    _stats.bus_us += duration;
+    emu_advance(duration);
+}
+
+esp_err_t Shtc3Emulator::nack(uint32_t scl_hz) {
+    _stats.nacks++;
+    account(0, scl_hz);
+    return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t Shtc3Emulator::transmit(const uint8_t *data, size_t len, uint32_t scl_hz) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    const int64_t now = emu_now();
+    uint16_t command = len == 2 ? (data[0] << 8) | data[1] : 0;
+
+    // asleep, only the wakeup command is acknowledged
+    if (_asleep) {
+        if (command != 0x3517) return nack(scl_hz);
+        _asleep = false;
+        _idleAt = now + EMU_SHTC3_WAKEUP_US;
+        _wakeups++;
+        account(len, scl_hz);
+        return ESP_OK;
+    }
+    // still waking up or converting
+    if (now < _idleAt || (_readyAt && now < _readyAt)) return nack(scl_hz);
+
+    switch (command) {
+    case 0x3517:
+        break;
+    case 0xB098:
+        _asleep = true;
+        _readyAt = 0;
+        _result = false;
+        break;
+    case 0x7CA2:
+    case 0x7866:
+    case 0x6458:
+    case 0x609C: {
+        bool low_power = command == 0x6458 || command == 0x609C;
+        _stretch = command == 0x7CA2 || command == 0x6458;
+        _result = false;
+        account(len, scl_hz);
+        _readyAt = emu_now() + (low_power ? EMU_SHTC3_MEASURE_LP_US : EMU_SHTC3_MEASURE_US);
+        _conversions++;
+        return ESP_OK;
+    }
+    default:
+        return nack(scl_hz);
+    }
+    account(len, scl_hz);
+    return ESP_OK;
+}
+
+esp_err_t Shtc3Emulator::receive(uint8_t *data, size_t len, uint32_t scl_hz) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    if (_asleep || (!_readyAt && !_result)) return nack(scl_hz);
+    if (_readyAt) {
+        int64_t now = emu_now();
+        if (now < _readyAt) {
+            if (!_stretch) return nack(scl_hz);
+            // the address is acknowledged, then SCL is held until the data is there
+            _stats.bus_us += _readyAt - now;
+            emu_advance(_readyAt - now);
+        }
+        _readyAt = 0;
+        _result = true;
+    }
+
+    uint8_t words[6] = {
+        (uint8_t)(_tempRaw >> 8), (uint8_t)_tempRaw, crc8(_tempRaw >> 8, _tempRaw),
+        (uint8_t)(_humRaw >> 8), (uint8_t)_humRaw, crc8(_humRaw >> 8, _humRaw),
+    };
+    if (_corruptNext) {
+        _corruptNext--;
+        words[1] ^= 0x01;
+    }
+    memcpy(data, words, len < sizeof(words) ? len : sizeof(words));
+    _result = false;
+    account(len, scl_hz);
+    return ESP_OK;
+}
+
+void Shtc3Emulator::setReading(uint16_t temp_raw, uint16_t hum_raw) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _tempRaw = temp_raw;
+    _humRaw = hum_raw;
+}
+
+void Shtc3Emulator::corruptNext(uint32_t n) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _corruptNext = n;
+}
+
+bool Shtc3Emulator::asleep() const {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _asleep;
+}
+
+uint32_t Shtc3Emulator::wakeups() const {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _wakeups;
+}
+
+uint32_t Shtc3Emulator::conversions() const {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _conversions;
+}
+
+emu_stats_t Shtc3Emulator::stats() const {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _stats;
+}
+
+void Shtc3Emulator::resetStats() {
+    std::lock_guard<std::mutex> guard(_mutex);
+    memset(&_stats, 0, sizeof(_stats));
+}
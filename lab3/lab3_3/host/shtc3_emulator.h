@@ -0,0 +1,65 @@
+/*!
+ * @file shtc3_emulator.h
+ * @brief Host model of the SHTC3 temperature/humidity sensor, fed by the
+ *        i2c_master stubs on the same virtual clock as the LCD emulator
+ */
+
+#ifndef __SHTC3_EMULATOR_H__
+#define __SHTC3_EMULATOR_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include "esp_err.h"
+#include "lcd_emulator.h"
+
+// typical datasheet timings the model runs at
+#define EMU_SHTC3_WAKEUP_US 180
+#define EMU_SHTC3_MEASURE_US 10800
+#define EMU_SHTC3_MEASURE_LP_US 700
+
+class Shtc3Emulator {
+public:
+    Shtc3Emulator(uint8_t addr = 0x70);
+
+    // power-on state: idle, nothing measured
+    void reset();
+    uint8_t address() const;
+
+    // one transaction as seen on the bus, called by the i2c_master stubs
+    esp_err_t transmit(const uint8_t *data, size_t len, uint32_t scl_hz);
+    esp_err_t receive(uint8_t *data, size_t len, uint32_t scl_hz);
+
+    // raw words the next conversions return
+    void setReading(uint16_t temp_raw, uint16_t hum_raw);
+    // fault injection: flip a bit of the temperature word in the next n results
+    void corruptNext(uint32_t n);
+
+    bool asleep() const;
+    uint32_t wakeups() const;
+    uint32_t conversions() const;
+
+    emu_stats_t stats() const;
+    void resetStats();
+
+private:
+    esp_err_t nack(uint32_t scl_hz);
+    void account(size_t len, uint32_t scl_hz);
+
+    mutable std::mutex _mutex;
+    uint8_t _addr;
+    bool _asleep;
+    int64_t _idleAt;        // wakeup done
+    int64_t _readyAt;       // conversion done, 0 if none runs
+    bool _stretch;          // the running conversion holds SCL on an early read
+    bool _result;           // a result waits to be read
+    uint16_t _tempRaw, _humRaw;
+    uint32_t _corruptNext;
+    uint32_t _wakeups, _conversions;
+    emu_stats_t _stats;
+};
+
+// the sensor on each I2C port
+Shtc3Emulator &shtc3_emulator(int port = 0);
+
+#endif // __SHTC3_EMULATOR_H__
@@ -0,0 +1,9 @@
+// Host stand-in for ESP-IDF's driver/gpio.h, pin numbers only
+#pragma once
+
+typedef int gpio_num_t;
+
+#define GPIO_NUM_4 4
+#define GPIO_NUM_5 5
+#define GPIO_NUM_8 8
+#define GPIO_NUM_10 10
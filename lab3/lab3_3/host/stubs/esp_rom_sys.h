@@ -0,0 +1,12 @@
+// Host stand-in for ESP-IDF's esp_rom_sys.h, delays advance the virtual clock
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void esp_rom_delay_us(uint32_t us);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,31 @@
+// Host stand-in for FreeRTOS, backed by std::thread primitives in idf_stubs.cpp
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef unsigned int UBaseType_t;
+typedef int BaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ 100
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)((ms) * configTICK_RATE_HZ / 1000))
+#define tskIDLE_PRIORITY 0
+
+typedef struct host_queue *QueueHandle_t;
+typedef struct host_queue *SemaphoreHandle_t;
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+// critical sections are a spinlock: on the host every task is a thread, so
+// there is no preemption to turn off, only other threads to keep out
+typedef struct {
+    int locked;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portMUX_INITIALIZE(mux) ((mux)->locked = 0)
@@ -0,0 +1,15 @@
+// Host-only helpers on top of the stubs
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+// wait until every task blocked on a queue has drained it
+void host_wait_idle(void);
+// fire the timers that came due by now, called by emu_advance()
+void host_run_timers(int64_t now);
+#ifdef __cplusplus
+}
+#endif
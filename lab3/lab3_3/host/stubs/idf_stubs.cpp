@@ -0,0 +1,404 @@
+/*!
+ * @file idf_stubs.cpp
+ * @brief Host implementations of the ESP-IDF and FreeRTOS calls DFRobot_LCD
+ *        and the shared drivers make: I2C goes to the emulators, time is
+ *        their virtual clock, tasks and queues are std::thread primitives
+ */
+
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "driver/i2c_master.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "host_stubs.h"
+#include "icm42670_emulator.h"
+#include "lcd_emulator.h"
+#include "shtc3_emulator.h"
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_NOT_FINISHED: return "ESP_ERR_NOT_FINISHED";
+    default: return "ESP_ERR_UNKNOWN";
+    }
+}
+
+// ---- time ----
+
+int64_t esp_timer_get_time(void) {
+    return emu_now();
+}
+
+void esp_rom_delay_us(uint32_t us) {
+    emu_advance(us);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    emu_advance((int64_t)ticks * portTICK_PERIOD_MS * 1000);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return emu_now() / (portTICK_PERIOD_MS * 1000);
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *previous_wake, TickType_t increment) {
+    *previous_wake += increment;
+    int64_t wake = (int64_t)*previous_wake * portTICK_PERIOD_MS * 1000;
+    if (wake <= emu_now()) return pdFALSE;
+    emu_advance(wake - emu_now());
+    return pdTRUE;
+}
+
+void vPortEnterCritical(portMUX_TYPE *mux) {
+    while (__atomic_exchange_n(&mux->locked, 1, __ATOMIC_ACQUIRE)) {
+        std::this_thread::yield();
+    }
+}
+
+void vPortExitCritical(portMUX_TYPE *mux) {
+    __atomic_store_n(&mux->locked, 0, __ATOMIC_RELEASE);
+}
+
+// timers run on the virtual clock, their callbacks on whichever thread
+// moves it past the deadline
+struct host_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    int64_t period;             // 0 for a one-shot timer
+    int64_t next;
+    bool running;
+};
+
+static std::mutex s_timers_mutex;
+static std::vector<host_timer *> s_timers;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle) {
+    host_timer *timer = new host_timer{args->callback, args->arg, 0, 0, false};
+    std::lock_guard<std::mutex> guard(s_timers_mutex);
+    s_timers.push_back(timer);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    std::lock_guard<std::mutex> guard(s_timers_mutex);
+    if (timer->running) return ESP_ERR_INVALID_STATE;
+    timer->period = 0;
+    timer->next = emu_now() + timeout_us;
+    timer->running = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    std::lock_guard<std::mutex> guard(s_timers_mutex);
+    if (timer->running) return ESP_ERR_INVALID_STATE;
+    timer->period = period;
+    timer->next = emu_now() + period;
+    timer->running = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> guard(s_timers_mutex);
+    if (!timer->running) return ESP_ERR_INVALID_STATE;
+    timer->running = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> guard(s_timers_mutex);
+    for (size_t i = 0; i < s_timers.size(); i++) {
+        if (s_timers[i] == timer) s_timers.erase(s_timers.begin() + i);
+    }
+    delete timer;
+    return ESP_OK;
+}
+
+// earliest deadline of a running timer, -1 if none runs
+static int64_t next_deadline() {
+    std::lock_guard<std::mutex> guard(s_timers_mutex);
+    int64_t next = -1;
+    for (host_timer *timer : s_timers) {
+        if (timer->running && (next < 0 || timer->next < next)) next = timer->next;
+    }
+    return next;
+}
+
+// a deadline that was passed several times over fires once, like
+// skip_unhandled_events
+void host_run_timers(int64_t now) {
+    // a callback that advances the clock itself must not recurse
+    static thread_local bool running = false;
+    if (running) return;
+    running = true;
+
+    for (;;) {
+        esp_timer_cb_t callback = NULL;
+        void *arg = NULL;
+        {
+            std::lock_guard<std::mutex> guard(s_timers_mutex);
+            for (host_timer *timer : s_timers) {
+                if (timer->running && timer->next <= now) {
+                    callback = timer->callback;
+                    arg = timer->arg;
+                    if (timer->period == 0) {
+                        timer->running = false;
+                    }
+                    while (timer->running && timer->next <= now) timer->next += timer->period;
+                    break;
+                }
+            }
+        }
+        if (callback == NULL) break;
+        callback(arg);
+    }
+    running = false;
+}
+
+// ---- I2C ----
+
+struct i2c_master_bus_t {
+    i2c_port_num_t port;
+};
+
+struct i2c_master_dev_t {
+    i2c_master_bus_t *bus;
+    uint16_t addr;
+    uint32_t scl_hz;
+};
+
+static i2c_master_bus_t *s_buses[EMU_PORTS];
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *config, i2c_master_bus_handle_t *ret_bus) {
+    if (config->i2c_port < 0 || config->i2c_port >= EMU_PORTS) return ESP_ERR_INVALID_ARG;
+    if (s_buses[config->i2c_port]) return ESP_ERR_INVALID_STATE;
+    s_buses[config->i2c_port] = new i2c_master_bus_t{config->i2c_port};
+    *ret_bus = s_buses[config->i2c_port];
+    return ESP_OK;
+}
+
+esp_err_t i2c_del_master_bus(i2c_master_bus_handle_t bus) {
+    s_buses[bus->port] = NULL;
+    delete bus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_get_bus_handle(i2c_port_num_t port, i2c_master_bus_handle_t *ret_bus) {
+    if (port < 0 || port >= EMU_PORTS || !s_buses[port]) return ESP_ERR_INVALID_STATE;
+    *ret_bus = s_buses[port];
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus, const i2c_device_config_t *config,
+                                    i2c_master_dev_handle_t *ret_dev) {
+    if (!bus) return ESP_ERR_INVALID_ARG;
+    *ret_dev = new i2c_master_dev_t{bus, config->device_address, config->scl_speed_hz};
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t dev) {
+    delete dev;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_probe(i2c_master_bus_handle_t bus, uint16_t address, int timeout_ms) {
+    (void)timeout_ms;
+    if (address == shtc3_emulator(bus->port).address()) {
+        // a sleeping sensor NACKs everything but its wakeup command
+        return shtc3_emulator(bus->port).asleep() ? ESP_ERR_NOT_FOUND : ESP_OK;
+    }
+    if (address == icm42670_emulator(bus->port).address()) return ESP_OK;
+    return lcd_emulator(bus->port).transmit(address, NULL, 0, 100000) == ESP_OK ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t dev, const uint8_t *data, size_t size, int timeout_ms) {
+    (void)timeout_ms;
+    if (!dev) return ESP_ERR_INVALID_ARG;
+    if (dev->addr == shtc3_emulator(dev->bus->port).address()) {
+        return shtc3_emulator(dev->bus->port).transmit(data, size, dev->scl_hz);
+    }
+    if (dev->addr == icm42670_emulator(dev->bus->port).address()) {
+        return icm42670_emulator(dev->bus->port).transmit(data, size, dev->scl_hz);
+    }
+    return lcd_emulator(dev->bus->port).transmit(dev->addr, data, size, dev->scl_hz);
+}
+
+// only the sensors can be read from, the LCD controllers are write-only
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t dev, uint8_t *data, size_t size, int timeout_ms) {
+    (void)timeout_ms;
+    if (!dev) return ESP_ERR_INVALID_ARG;
+    if (dev->addr == shtc3_emulator(dev->bus->port).address()) {
+        return shtc3_emulator(dev->bus->port).receive(data, size, dev->scl_hz);
+    }
+    if (dev->addr == icm42670_emulator(dev->bus->port).address()) {
+        return icm42670_emulator(dev->bus->port).receive(data, size, dev->scl_hz);
+    }
+    return lcd_emulator(dev->bus->port).nack(dev->scl_hz);
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t dev, const uint8_t *tx, size_t tx_size,
+                                      uint8_t *rx, size_t rx_size, int timeout_ms) {
+    // a register pointer then a repeated start, only the IMU has registers
+    if (dev && dev->addr == icm42670_emulator(dev->bus->port).address()) {
+        return icm42670_emulator(dev->bus->port).transmitReceive(tx, tx_size, rx, rx_size, dev->scl_hz);
+    }
+    return i2c_master_receive(dev, rx, rx_size, timeout_ms);
+}
+
+// ---- FreeRTOS ----
+
+// a queue of fixed-size items; a mutex is a queue of one empty item
+struct host_queue {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::vector<uint8_t>> items;
+    size_t length;
+    size_t item_size;
+    int receivers_waiting;
+    bool timed;     // binary semaphore, see xSemaphoreTake()
+};
+
+static std::mutex s_queues_mutex;
+static std::vector<host_queue *> s_queues;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    host_queue *queue = new host_queue();
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->receivers_waiting = 0;
+    queue->timed = false;
+    std::lock_guard<std::mutex> guard(s_queues_mutex);
+    s_queues.push_back(queue);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> guard(s_queues_mutex);
+    for (size_t i = 0; i < s_queues.size(); i++) {
+        if (s_queues[i] == queue) s_queues.erase(s_queues.begin() + i);
+    }
+    delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (queue->items.size() >= queue->length) {
+        if (wait == 0) return pdFALSE;
+        queue->cv.wait(lock, [queue] { return queue->items.size() < queue->length; });
+    }
+    const uint8_t *bytes = (const uint8_t *)item;
+    queue->items.emplace_back(bytes, bytes + queue->item_size);
+    queue->cv.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (queue->items.empty()) {
+        if (wait == 0) return pdFALSE;
+        queue->receivers_waiting++;
+        queue->cv.notify_all();
+        queue->cv.wait(lock, [queue] { return !queue->items.empty(); });
+        queue->receivers_waiting--;
+    }
+    if (queue->item_size) {
+        memcpy(item, queue->items.front().data(), queue->item_size);
+    }
+    queue->items.pop_front();
+    queue->cv.notify_all();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> guard(queue->mutex);
+    return queue->items.size();
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+    xQueueSend(sem, NULL, 0);
+    return sem;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    vQueueDelete(sem);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+    sem->timed = true;
+    return sem;
+}
+
+// binary semaphores are given by timer callbacks: a task blocked on one lets
+// the virtual clock run to the next deadline instead of waiting for another
+// thread to move it
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait) {
+    while (sem->timed && wait != 0) {
+        if (xQueueReceive(sem, NULL, 0)) return pdTRUE;
+        int64_t next = next_deadline();
+        if (next < 0) break;
+        emu_advance(next > emu_now() ? next - emu_now() : 0);
+    }
+    return xQueueReceive(sem, NULL, wait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    return xQueueSend(sem, NULL, 0);
+}
+
+struct host_task {
+    std::thread thread;
+};
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack,
+                       void *arg, UBaseType_t priority, TaskHandle_t *handle) {
+    (void)name;
+    (void)stack;
+    (void)priority;
+    host_task *task = new host_task();
+    task->thread = std::thread(fn, arg);
+    task->thread.detach();
+    if (handle) *handle = task;
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+    // host tasks run until the process exits
+    (void)handle;
+}
+
+// block until every queue with a task waiting on it is empty and that task
+// is back to waiting, i.e. it finished whatever it took off the queue
+void host_wait_idle(void) {
+    for (;;) {
+        bool idle = true;
+        {
+            std::lock_guard<std::mutex> guard(s_queues_mutex);
+            for (host_queue *queue : s_queues) {
+                std::lock_guard<std::mutex> qguard(queue->mutex);
+                if (queue->item_size && (!queue->items.empty() || queue->receivers_waiting == 0)) {
+                    idle = false;
+                }
+            }
+        }
+        if (idle) return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
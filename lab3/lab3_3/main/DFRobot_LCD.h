@@ -2,11 +2,22 @@
 #define __DFRobot_LCD_H__
 
 #include <inttypes.h>
-#include "driver/i2c.h"
+#include "driver/i2c_master.h"
+#include "i2c_bus.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
 
 // LCD device I2C addresses
 #define LCD_ADDRESS     0x3E
 #define RGB_ADDRESS     0x2D
+#define LCD_I2C_FREQ_HZ I2C_BUS_FAST_HZ   // both controllers take fast mode
+
+// per attempt; long enough to wait out an SHTC3 measurement holding the bus
+#define LCD_I2C_TIMEOUT_MS 50
+#define LCD_I2C_RETRIES 2
 
 // color definitions
 #define WHITE           0
@@ -25,6 +36,9 @@
 #define REG_MODE2       0x01
 #define REG_OUTPUT      0x08
 
+#define REG_AUTOINC     0x80        // register pointer auto-increment flag
+#define REG_COUNT       16
+
 // command definitions
 #define LCD_CLEARDISPLAY 0x01
 #define LCD_RETURNHOME 0x02
@@ -63,11 +77,80 @@
 #define LCD_5x10DOTS 0x04
 #define LCD_5x8DOTS 0x00
 
+// bargraph types for init_bargraph
+#define LCD_VERTICAL_BAR_GRAPH 1
+#define LCD_HORIZONTAL_BAR_GRAPH 2
+#define LCD_HORIZONTAL_LINE_GRAPH 3
+
+// glyph manager: registered glyphs share the 8 CGRAM slots
+#define LCD_CGRAM_SLOTS 8
+#define LCD_MAX_GLYPHS 32
+
+typedef struct {
+    uint8_t id;
+    uint8_t charmap[8];
+} lcd_glyph_t;
+
+// shadow framebuffer limits (DDRAM holds 80 cells: 2 lines of 40 or 4 lines of 20)
+#define LCD_MAX_COLS 40
+#define LCD_MAX_ROWS 4
+
+// DDRAM address of the first cell of a row: rows 0/1 start the two 40-cell
+// lines, rows 2/3 of a four-row panel continue them after the first cols cells
+constexpr uint8_t lcd_row_offset(uint8_t cols, uint8_t row) {
+    return (row & 1 ? 0x40 : 0x00) + (row & 2 ? cols : 0);
+}
+
+// clean cells a flush will rewrite to keep a run in one burst; cheaper than
+// starting a new address set + data transaction (~5 bytes on the wire)
+#define LCD_FLUSH_MAX_GAP 4
+
+// async render task
+#define LCD_QUEUE_DEPTH 32
+// how long an op that changes controller state waits for room in a full
+// queue before the driver falls back to a resync
+#define LCD_POST_WAIT_MS 20
+#define LCD_TASK_STACK 3072
+#define LCD_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+
+// refresh scheduler: frames per second applied to the panel
+#define LCD_REFRESH_FPS 20
+
+// bus traffic and failures of one display since the last resetStats()
+typedef struct {
+    uint32_t transactions;      // attempts, retries included
+    uint32_t bytes;             // on the wire, address bytes included
+    uint32_t nacks;
+    uint32_t timeouts;
+    uint32_t retries;
+    uint32_t failures;          // transactions that failed every attempt
+    uint32_t resyncs;
+    uint32_t max_latency_us;    // slowest transaction, retries included
+} lcd_stats_t;
+
+// one recorded operation in async mode
+typedef struct {
+    uint8_t type;
+    uint8_t arg;
+    uint8_t data[8];
+} lcd_op_t;
+
 class DFRobot_LCD {
 public:
     DFRobot_LCD(uint8_t lcd_cols, uint8_t lcd_rows, uint8_t lcd_Addr = LCD_ADDRESS, uint8_t RGB_Addr = RGB_ADDRESS);
     
     void init();
+    void init(i2c_master_bus_handle_t bus, uint32_t max_scl_hz = LCD_I2C_FREQ_HZ);
+    void init(i2c_master_dev_handle_t lcd, i2c_master_dev_handle_t rgb);
+    bool startAsync(UBaseType_t priority = LCD_TASK_PRIORITY);
+    bool startRefresh(uint8_t fps = LCD_REFRESH_FPS);
+    void stopRefresh();
+    uint32_t measuredFps();
+    uint32_t droppedUpdates();
+    uint32_t droppedOps();
+    lcd_stats_t stats();
+    void resetStats();
+    void resync();
     void clear();
     void home();
     void noDisplay();
@@ -90,6 +173,7 @@ public:
     void blinkLED();
     void noBlinkLED();
     virtual size_t write(uint8_t);
+    size_t write(const uint8_t *buffer, size_t size);
     void command(uint8_t);
     
     void blink_on();
@@ -99,6 +183,17 @@ public:
     void setBacklight(uint8_t new_val);
     void load_custom_character(uint8_t char_num, uint8_t *rows);
     void printstr(const char c[]);
+    void flush();
+
+    bool marquee(uint8_t row, const char *text);
+    void marqueeStep();
+    void marqueeStop();
+
+    bool registerGlyph(uint8_t id, const uint8_t charmap[8]);
+    int glyph(uint8_t id);
+    void printGlyph(uint8_t id);
+    uint32_t glyphHits();
+    uint32_t glyphMisses();
     
     uint8_t status();
     void setContrast(uint8_t new_val);
@@ -108,13 +203,37 @@ public:
     void off();
     uint8_t init_bargraph(uint8_t graphtype);
     void draw_horizontal_graph(uint8_t row, uint8_t column, uint8_t len,  uint8_t pixel_col_end);
-    void draw_vertical_graph(uint8_t row, uint8_t column, uint8_t len,  uint8_t pixel_col_end);
-    
+    void draw_vertical_graph(uint8_t row, uint8_t column, uint8_t len,  uint8_t pixel_row_end);
+
 private:
     void begin(uint8_t cols, uint8_t rows, uint8_t charsize = LCD_5x8DOTS);
-    void send(uint8_t *data, uint8_t len);
+    esp_err_t send(const uint8_t *data, size_t len);
+    esp_err_t transmit(i2c_bus_dev_t *dev, const uint8_t *data, size_t len);
     void setReg(uint8_t addr, uint8_t data);
 
+    // bus side, called directly in sync mode or by the render task
+    void runCommand(uint8_t value);
+    void waitReady();
+    void sendData(const uint8_t *buffer, size_t size);
+    esp_err_t sendAt(uint8_t value, const uint8_t *buffer, size_t size);
+    void resyncNow();
+    void uploadSlot(uint8_t slot, const uint8_t charmap[8]);
+    void visibleSlots(bool visible[LCD_CGRAM_SLOTS]);
+    bool moveGlyph(uint8_t from, uint8_t reserved, bool visible[LCD_CGRAM_SLOTS]);
+    void writeReg(uint8_t addr, uint8_t data);
+    void writeRGB(uint8_t r, uint8_t g, uint8_t b);
+    void flushNow();
+    void execute(const lcd_op_t &op);
+
+    bool post(const lcd_op_t &op);
+    void lock();
+    void unlock();
+    static void renderTask(void *arg);
+    void render();
+    void postFlush();
+    static void refreshTimer(void *arg);
+    void refreshTick();
+
     uint8_t _showfunction;
     uint8_t _showcontrol;
     uint8_t _showmode;
@@ -125,6 +244,70 @@ private:
     uint8_t _cols;
     uint8_t _rows;
     uint8_t _backlightval;
+    uint8_t _graphtype;     // glyph set currently in CGRAM, 0 if none
+    int64_t _readyAt;       // esp_timer time the controller is free again
+
+    // registered glyphs and which of them sits in each CGRAM slot (-1 for
+    // none or a raw customSymbol upload), with LRU stamps per slot
+    lcd_glyph_t _glyphs[LCD_MAX_GLYPHS];
+    uint8_t _glyphCount;
+    int8_t _slotGlyph[LCD_CGRAM_SLOTS];
+    uint32_t _slotUsed[LCD_CGRAM_SLOTS];
+    uint32_t _glyphClock;
+    uint32_t _glyphHits, _glyphMisses;
+
+    // what was last uploaded to each CGRAM slot, for resync
+    uint8_t _cgram[LCD_CGRAM_SLOTS][8];
+
+    i2c_bus_dev_t _lcdDev;
+    i2c_bus_dev_t _rgbDev;
+
+    // last value written to each RGB controller register, bit n of
+    // _rgbValid says whether _rgbRegs[n] is known
+    uint8_t _rgbRegs[REG_COUNT];
+    uint16_t _rgbValid;
+
+    // printstr/setCursor only touch _shadow; flush() sends the cells that
+    // differ from _panel, which mirrors what the controller is showing.
+    // Only the flushing side writes _panel, under _lock since glyph() reads it
+    uint8_t _shadow[LCD_MAX_ROWS][LCD_MAX_COLS];
+    uint8_t _panel[LCD_MAX_ROWS][LCD_MAX_COLS];
+    uint8_t _col, _row;
+    uint8_t _rowOffset[LCD_MAX_ROWS];   // lcd_row_offset() for each row
+
+    // cells per row that flush() tracks: _cols, or the whole 40-cell DDRAM
+    // line for a marquee row. _shift is the hardware display shift, in
+    // cells to the left
+    uint8_t _lineCols[LCD_MAX_ROWS];
+    uint8_t _shift;
+
+    // async mode: the public API only posts to _queue and the render task is
+    // the only one touching the bus; _lock guards _shadow against it
+    bool _async;
+    QueueHandle_t _queue;
+    SemaphoreHandle_t _lock;
+    TaskHandle_t _task;
+    volatile bool _flushPending;
+    volatile bool _rgbPending;
+    uint8_t _pendingRGB[3];
+
+    // refresh scheduler: flush() and setRGB() only mark the frame, the timer
+    // hands at most one of each to the render task per period
+    esp_timer_handle_t _refreshTimer;
+    uint8_t _fps;
+    volatile bool _frameRequested;
+    volatile bool _rgbDeferred;
+    uint32_t _droppedUpdates;
+    volatile uint32_t _framesDrawn;     // flushes the render task applied
+    uint32_t _fpsTicks, _fpsFrames;
+    int64_t _fpsSince;
+    uint32_t _measuredFps;
+    uint32_t _droppedOps;
+
+    // a transaction failed for good, the controllers are rewritten from our
+    // own state before the next flush
+    lcd_stats_t _stats;
+    volatile bool _resyncPending;
 };
 
 // Declare i2c_master_init so it can be used in other files
@@ -0,0 +1,83 @@
+/*!
+ * @file LCD_Widgets.cpp
+ * @brief Fixed-point dashboard fields on top of DFRobot_LCD
+ */
+
+#include <string.h>
+#include "LCD_Widgets.h"
+
+size_t lcd_format_fixed(char *buf, size_t size, int32_t value, uint8_t decimals) {
+    char digits[12];
+    size_t n = 0, len = 0;
+    uint32_t mag = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+
+    if (size == 0) return 0;
+    // up to 10 digits plus the zero left of the point
+    if (decimals > sizeof(digits) - 2) decimals = sizeof(digits) - 2;
+
+    // least significant digit first, at least one digit left of the point
+    do {
+        digits[n++] = '0' + mag % 10;
+        mag /= 10;
+    } while (mag || n <= decimals);
+
+    if (value < 0 && len + 1 < size) buf[len++] = '-';
+    while (n && len + 1 < size) {
+        buf[len++] = digits[--n];
+        if (n == decimals && decimals && len + 1 < size) buf[len++] = '.';
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+LCDField::LCDField(DFRobot_LCD &lcd, uint8_t col, uint8_t row, const char *label,
+                   uint8_t width, uint8_t decimals, const char *unit)
+    : _lcd(lcd) {
+    _col = col;
+    _row = row;
+    _label = label;
+    _unit = unit;
+    _width = width;
+    _decimals = decimals;
+    _value = 0;
+    _drawn = false;
+}
+
+// redraws into the LCD's shadow buffer only when the value changed; the
+// next flush() then sends just the cells that differ
+void LCDField::set(int32_t value) {
+    if (_drawn && value == _value) return;
+    _value = value;
+    _drawn = true;
+    render();
+}
+
+void LCDField::render() {
+    char text[LCD_MAX_COLS + 1];
+    char number[16];
+    size_t len = strlen(_label);
+
+    if (len > LCD_MAX_COLS) len = LCD_MAX_COLS;
+    memcpy(text, _label, len);
+
+    size_t digits = lcd_format_fixed(number, sizeof(number), _value, _decimals);
+    if (digits > _width) {
+        // a cut-down number would read as a plausible value, fill it instead
+        digits = _width;
+        memset(number, '#', digits);
+    }
+    for (size_t pad = digits; pad < _width && len < LCD_MAX_COLS; pad++) {
+        text[len++] = ' ';
+    }
+    for (size_t i = 0; i < digits && len < LCD_MAX_COLS; i++) {
+        text[len++] = number[i];
+    }
+    for (size_t i = 0; _unit[i] && len < LCD_MAX_COLS; i++) {
+        text[len++] = _unit[i];
+    }
+    text[len] = '\0';
+
+    // printstr stops at the last column of the panel
+    _lcd.setCursor(_col, _row);
+    _lcd.printstr(text);
+}
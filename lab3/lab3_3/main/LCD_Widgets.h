@@ -0,0 +1,36 @@
+#ifndef __LCD_WIDGETS_H__
+#define __LCD_WIDGETS_H__
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "DFRobot_LCD.h"
+
+// integer/fixed-point formatting without printf: value is in units of
+// 10^-decimals, so (2315, 2) is "23.15"; decimals beyond the 10 digits an
+// int32_t can hold are clamped to 10; returns the length written
+size_t lcd_format_fixed(char *buf, size_t size, int32_t value, uint8_t decimals);
+
+// a labeled number at a fixed position, e.g. "Temp:  23C"; the number is
+// right-aligned in width cells so digits keep their cells between updates,
+// and shown as width '#'s when it does not fit so the unit never moves
+class LCDField {
+public:
+    LCDField(DFRobot_LCD &lcd, uint8_t col, uint8_t row, const char *label,
+             uint8_t width, uint8_t decimals = 0, const char *unit = "");
+
+    void set(int32_t value);
+
+private:
+    void render();
+
+    DFRobot_LCD &_lcd;
+    uint8_t _col, _row;
+    const char *_label;
+    const char *_unit;
+    uint8_t _width;
+    uint8_t _decimals;
+    int32_t _value;
+    bool _drawn;
+};
+
+#endif // __LCD_WIDGETS_H__
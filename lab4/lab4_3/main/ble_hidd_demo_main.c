@@ -8,7 +8,8 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "driver/i2c.h"
+#include "i2c_bus.h"
+#include "icm42670.h"
 #include "esp_log.h"
 #include <stdint.h>
 
@@ -52,19 +53,6 @@
  */
 
 #define HID_DEMO_TAG "HID_DEMO"
-#define I2C_MASTER_NUM I2C_NUM_0
-#define I2C_MASTER_SDA_IO 10
-#define I2C_MASTER_SCL_IO 8
-#define I2C_MASTER_FREQ_HZ 100000
-
-#define ICM42670_ADDR 0x68
-#define PWR_MGMT0 0x1F
-#define ACCEL_CONFIG0 0x21
-#define ACCEL_CONFIG1 0x24
-#define ACCEL_DATA_X1 0x0B
-#define ACCEL_DATA_X0 0x0C
-#define ACCEL_DATA_Y1 0x0D
-#define ACCEL_DATA_Y0 0x0E
 
 #define THRESHOLD 1000
 
@@ -109,56 +97,24 @@ static esp_ble_adv_params_t hidd_adv_params = {
 };
 
 
-void i2c_master_init() {
-    i2c_config_t config = {
-        .mode = I2C_MODE_MASTER,
-        .sda_io_num = I2C_MASTER_SDA_IO,
-        .scl_io_num = I2C_MASTER_SCL_IO,
-        .sda_pullup_en = GPIO_PULLUP_ENABLE,
-        .scl_pullup_en = GPIO_PULLUP_ENABLE,
-        .master.clk_speed = I2C_MASTER_FREQ_HZ,
-    };
-    i2c_param_config(I2C_MASTER_NUM, &config);
-    i2c_driver_install(I2C_MASTER_NUM, config.mode, 0, 0, 0);
-}
-
-// write a byte to a register
-esp_err_t i2c_write_byte(uint8_t reg, uint8_t data) {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (ICM42670_ADDR << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(cmd, reg, true);
-    i2c_master_write_byte(cmd, data, true);
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, 1000 / portTICK_PERIOD_MS);
-    i2c_cmd_link_delete(cmd);
-    return ret;
-}
+static icm42670_t icm42670;
 
-// read a single byte from a register
-esp_err_t i2c_read_byte(uint8_t reg, uint8_t *data) {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (ICM42670_ADDR << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(cmd, reg, true);
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (ICM42670_ADDR << 1) | I2C_MASTER_READ, true);
-    i2c_master_read_byte(cmd, data, I2C_MASTER_NACK);
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, 1000 / portTICK_PERIOD_MS);
-    i2c_cmd_link_delete(cmd);
-    return ret;
+void i2c_master_init() {
+    i2c_master_bus_handle_t bus;
+    if (icm42670.dev.handle != NULL) return;   // app_main and the HID task both call this
+    ESP_ERROR_CHECK(i2c_bus_init(&bus));
+    ESP_ERROR_CHECK(icm42670_init(&icm42670, bus));
 }
 
 void configure_icm42670() {
     // set accelerometer to low-noise mode and disable gyro
-    i2c_write_byte(PWR_MGMT0, 0x0B);
+    icm42670_write_reg(&icm42670, ICM42670_PWR_MGMT0, 0x0B);
     
     // set accel FSR to ±4g and ODR to 100Hz
-    i2c_write_byte(ACCEL_CONFIG0, 0x29);
+    icm42670_write_reg(&icm42670, ICM42670_ACCEL_CONFIG0, 0x29);
     
     // set accel filter bandwidth to 73Hz
-    i2c_write_byte(ACCEL_CONFIG1, 0x03);
+    icm42670_write_reg(&icm42670, ICM42670_ACCEL_CONFIG1, 0x03);
 }
 
 static void hidd_event_callback(esp_hidd_cb_event_t event, esp_hidd_cb_param_t *param)
@@ -250,18 +206,12 @@ void hid_demo_task(void *pvParameters)
         vTaskDelay(50 / portTICK_PERIOD_MS); // Check tilt every 50 ms
 
         if (sec_conn) {
-            uint8_t x_high, x_low, y_high, y_low;
-            int16_t x, y;
+            icm42670_axes_t accel;
             char direction[20] = "";
 
-            // Read accelerometer values from Part 1
-            i2c_read_byte(ACCEL_DATA_X1, &x_high);
-            i2c_read_byte(ACCEL_DATA_X0, &x_low);
-            x = (int16_t)((x_high << 8) | x_low);
-
-            i2c_read_byte(ACCEL_DATA_Y1, &y_high);
-            i2c_read_byte(ACCEL_DATA_Y0, &y_low);
-            y = (int16_t)((y_high << 8) | y_low);
+            // Read accelerometer values from Part 1, all axes of one sample in one burst
+            if (icm42670_read_accel(&icm42670, &accel) != ESP_OK) continue;
+            int16_t x = accel.x, y = accel.y;
 
             int x_delta = 0, y_delta = 0;
             int base_speed = 1; // Base speed for mouse movement
@@ -1,69 +1,68 @@
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "driver/gpio.h"
-#include "driver/i2c.h"
-#include "esp_timer.h"
+#include "i2c_bus.h"
+#include "sampler.h"
+#include "shtc3.h"
+#include "sr04.h"
 
 // Ultrasonic sensor pin configuration
 #define TRIG_PIN GPIO_NUM_4
 #define ECHO_PIN GPIO_NUM_5
 
-// I2C Configuration
-#define I2C_MASTER_SCL_IO 8      // SCL on GPIO8
-#define I2C_MASTER_SDA_IO 10     // SDA on GPIO10
-#define I2C_MASTER_FREQ_HZ 100000  // 100kHz I2C clock
-#define I2C_MASTER_NUM I2C_NUM_0  // I2C port number
-#define SHTC3_ADDR 0x70          // I2C address for SHTC3 sensor
+// Logging tag
+static const char *TAG = "SR04_SHTC3";
 
-// I2C commands for SHTC3
-#define WAKEUP_CMD  0x3517
-#define MEASURE_CMD 0x7CA2
-#define SLEEP_CMD   0xB098
+// Sampling periods, each sensor on its own task
+#define SHTC3_PERIOD_MS 1000
+#define SR04_PERIOD_MS  100
 
-// Constants
-#define SPEED_OF_SOUND_BASE 331.3 // Speed of sound in m/s at 0°C
-#define TEMP_COEFFICIENT 0.606    // Change in speed of sound per °C
-#define TIMEOUT_US 30000          // 30ms timeout for pulse (30000us)
+static shtc3_t shtc3;
+static sr04_t sr04;
+static sampler_t shtc3_sampler;
+static sampler_t sr04_sampler;
 
-// Logging tag
-static const char *TAG = "SR04_SHTC3";
+// a ranging and the temperature it was corrected for
+typedef struct {
+    uint32_t distance_mm;
+    int32_t temperature_cC;
+} range_sample_t;
 
 // Function prototypes
 void i2c_master_init(void);
-esp_err_t write_command(uint16_t command);
-esp_err_t read_sensor(float *temperature_C, float *humidity);
 void ultrasonic_init(void);
-float read_distance(float temperature);
+void samplers_start(void);
+
+// hundredths of a degree as "-12.3", without going through float
+static const char *format_temperature(char *buf, size_t size, int32_t centi) {
+    int32_t tenths = (centi < 0 ? centi - 5 : centi + 5) / 10;
+    snprintf(buf, size, "%s%" PRId32 ".%" PRId32, tenths < 0 ? "-" : "",
+             abs(tenths) / 10, abs(tenths) % 10);
+    return buf;
+}
 
 void app_main(void) {
     // Initialize I2C and ultrasonic sensor
     i2c_master_init();
     ultrasonic_init();
+    samplers_start();
 
-    float temperature_C = 25.0; // Default temperature
-    float humidity = 50.0;      // Default humidity
-    float distance;
+    range_sample_t range;
+    int64_t timestamp_us;
+    char temperature[8];
 
     while (1) {
-        // Read temperature and humidity from the sensor
-        esp_err_t temp_read_status = read_sensor(&temperature_C, &humidity);
-
-        if (temp_read_status == ESP_OK) {
-            // ESP_LOGI(TAG, "Temperature: %.2f°C, Humidity: %.2f%%", temperature_C, humidity);
-        } else {
-            // ESP_LOGE(TAG, "Failed to read sensor data, using default values.");
-        }
-
-        // Calculate distance based on the current temperature
-        distance = read_distance(temperature_C);
-
-        // Print results to the monitor
-        if (distance >= 0) {
-            printf("Distance: %.2f cm at %.1f°C\n", distance, temperature_C);
+        // Print the range the sampler published last, no waiting on the sensor
+        if (sampler_latest(&sr04_sampler, &range, &timestamp_us, NULL) &&
+            esp_timer_get_time() - timestamp_us < 2 * SR04_PERIOD_MS * 1000) {
+            format_temperature(temperature, sizeof(temperature), range.temperature_cC);
+            printf("Distance: %" PRIu32 ".%" PRIu32 " cm at %s°C\n", range.distance_mm / 10, range.distance_mm % 10, temperature);
         } else {
-            printf("Distance measurement failed at %.1f°C\n", temperature_C);
+            printf("Distance measurement failed\n");
         }
 
         // Delay 1 second
@@ -73,108 +72,53 @@ void app_main(void) {
 
 // Initialize I2C with proper configuration
 void i2c_master_init() {
-    i2c_config_t conf = {
-        .mode = I2C_MODE_MASTER,
-        .sda_io_num = I2C_MASTER_SDA_IO,
-        .scl_io_num = I2C_MASTER_SCL_IO,
-        .sda_pullup_en = GPIO_PULLUP_ENABLE,
-        .scl_pullup_en = GPIO_PULLUP_ENABLE,
-        .master.clk_speed = I2C_MASTER_FREQ_HZ
-    };
-
-    ESP_ERROR_CHECK(i2c_param_config(I2C_MASTER_NUM, &conf));
-    ESP_ERROR_CHECK(i2c_driver_install(I2C_MASTER_NUM, I2C_MODE_MASTER, 0, 0, 0));
-    ESP_LOGI(TAG, "I2C driver installed successfully");
-}
-
-// Send I2C commands to the temperature sensor
-esp_err_t write_command(uint16_t command) {
-    uint8_t data[2] = {command >> 8, command & 0xFF};
-    esp_err_t ret = i2c_master_write_to_device(I2C_MASTER_NUM, SHTC3_ADDR, data, sizeof(data), 1000 / portTICK_PERIOD_MS);
-    return ret;
-}
-
-// Read temperature and humidity from the sensor
-esp_err_t read_sensor(float *temperature_C, float *humidity) {
-    uint8_t data[6];
-    esp_err_t ret;
-
-    // Wake up the sensor
-    ret = write_command(WAKEUP_CMD);
-    if (ret != ESP_OK) return ret;
-    vTaskDelay(1 / portTICK_PERIOD_MS);
-
-    // Send measurement command
-    ret = write_command(MEASURE_CMD);
-    if (ret != ESP_OK) return ret;
-    vTaskDelay(20 / portTICK_PERIOD_MS);
-
-    // Read 6 bytes from the sensor
-    ret = i2c_master_read_from_device(I2C_MASTER_NUM, SHTC3_ADDR, data, 6, 1000 / portTICK_PERIOD_MS);
-    // ESP_LOGI(TAG, "Raw data: %02X %02X %02X %02X %02X %02X", data[0], data[1], data[2], data[3], data[4], data[5]);
-
-    uint16_t temp_raw = (data[0] << 8) | data[1];
-    uint16_t hum_raw = (data[3] << 8) | data[4];
-
-    *temperature_C = -45 + (175.0 * (temp_raw / 65535.0));
-    // ESP_LOGI(TAG, "Temp: %f", -45 + (175.0 * (temp_raw / 65535.0)));
-    *humidity = 100.0 * (hum_raw / 65535.0);
-
-    // Put the sensor to sleep
-    write_command(SLEEP_CMD);
-    return ret;
+    i2c_master_bus_handle_t bus;
+    ESP_ERROR_CHECK(i2c_bus_init(&bus));
+    ESP_ERROR_CHECK(shtc3_init(&shtc3, bus));
+    ESP_LOGI(TAG, "I2C bus ready");
 }
 
 // Initialize the ultrasonic sensor
 void ultrasonic_init(void) {
-    gpio_config_t io_conf;
-
-    // Configure Trigger pin as output
-    io_conf.intr_type = GPIO_INTR_DISABLE;
-    io_conf.mode = GPIO_MODE_OUTPUT;
-    io_conf.pin_bit_mask = (1ULL << TRIG_PIN);
-    io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
-    io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
-    gpio_config(&io_conf);
-
-    // Configure Echo pin as input
-    io_conf.mode = GPIO_MODE_INPUT;
-    io_conf.pin_bit_mask = (1ULL << ECHO_PIN);
-    gpio_config(&io_conf);
-
+    ESP_ERROR_CHECK(sr04_init(&sr04, TRIG_PIN, ECHO_PIN));
     ESP_LOGI(TAG, "Ultrasonic sensor initialized");
 }
 
-// Function to calculate distance using SR04
-float read_distance(float temperature) {
-    float speed_of_sound = SPEED_OF_SOUND_BASE + (TEMP_COEFFICIENT * temperature);
-
-    // Trigger ultrasonic pulse
-    gpio_set_level(TRIG_PIN, 1);
-    esp_rom_delay_us(10); // 10µs pulse width
-    gpio_set_level(TRIG_PIN, 0);
-
-    // Wait for Echo signal to go HIGH
-    uint64_t start_time = esp_timer_get_time();
-    while (gpio_get_level(ECHO_PIN) == 0) {
-        if ((esp_timer_get_time() - start_time) > TIMEOUT_US) {
-            ESP_LOGW(TAG, "Echo timeout waiting for HIGH");
-            return -1; // Timeout
-        }
-    }
-
-    // Measure the HIGH duration of Echo signal
-    start_time = esp_timer_get_time();
-    while (gpio_get_level(ECHO_PIN) == 1) {
-        if ((esp_timer_get_time() - start_time) > TIMEOUT_US) {
-            ESP_LOGW(TAG, "Echo timeout waiting for LOW");
-            return -1; // Timeout
-        }
-    }
-    uint64_t duration = esp_timer_get_time() - start_time;
+static esp_err_t read_shtc3(void *ctx, void *sample) {
+    return shtc3_read((shtc3_t *)ctx, (shtc3_sample_t *)sample);
+}
 
-    // Convert duration to distance
-    float distance_cm = (duration * (speed_of_sound / 10000)) / 2;
+// range with the latest temperature, 25.00°C until the first one
+static esp_err_t read_sr04(void *ctx, void *sample) {
+    range_sample_t *range = (range_sample_t *)sample;
+    shtc3_sample_t climate = {.temperature_cC = 2500, .humidity_cRH = 5000};
+    sampler_latest(&shtc3_sampler, &climate, NULL, NULL);
+
+    uint32_t echo_us;
+    esp_err_t err = sr04_echo_us((sr04_t *)ctx, &echo_us);
+    if (err != ESP_OK) return err;
+    range->distance_mm = sr04_distance_mm(echo_us, climate.temperature_cC);
+    range->temperature_cC = climate.temperature_cC;
+    return ESP_OK;
+}
 
-    return distance_cm;
+// Start one sampling task per sensor
+void samplers_start(void) {
+    sampler_config_t climate = {
+        .name = "shtc3",
+        .read = read_shtc3,
+        .ctx = &shtc3,
+        .size = sizeof(shtc3_sample_t),
+        .period_ms = SHTC3_PERIOD_MS,
+    };
+    ESP_ERROR_CHECK(sampler_start(&shtc3_sampler, &climate));
+
+    sampler_config_t ranging = {
+        .name = "sr04",
+        .read = read_sr04,
+        .ctx = &sr04,
+        .size = sizeof(range_sample_t),
+        .period_ms = SR04_PERIOD_MS,
+    };
+    ESP_ERROR_CHECK(sampler_start(&sr04_sampler, &ranging));
 }